@@ -0,0 +1,582 @@
+//
+// Created by super on 6/12/23.
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sources/ConcurrentMagicalContainer.hpp"
+#include "sources/MagicalContainer.hpp"
+#include "sources/ShardedMagicalContainer.hpp"
+#include "sources/SnapshotMagicalContainer.hpp"
+
+using namespace ariel;
+using namespace std;
+
+/**
+ * The addElement implementation before the incremental prime index: every insert re-tests every element.
+ * Kept here only as a baseline to measure against.
+ */
+class RescanContainer {
+    vector<int> int_container;
+    vector<int> prime_indexes;
+
+    static bool isPrime(int num) {
+        if (num < 2) {
+            return false;
+        }
+        for (int i = 2; i <= sqrt(num); i++) {
+            if (num % i == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    void addElement(int elm) {
+        auto it = lower_bound(int_container.begin(), int_container.end(), elm);
+        int_container.insert(it, elm);
+        int counter = 0;
+        prime_indexes.clear();
+        for (auto element : int_container) {
+            if (isPrime(element)) {
+                prime_indexes.push_back(counter);
+            }
+            counter++;
+        }
+    }
+
+    int p_size() const {
+        return (int)prime_indexes.size();
+    }
+};
+
+/**
+ * @brief Inserts all the values into a fresh container and returns the average cost of one insert
+ */
+template<typename Container>
+double nsPerInsert(const vector<int>& values, int& primes) {
+    Container container;
+    auto start = chrono::steady_clock::now();
+    for (int value : values) {
+        container.addElement(value);
+    }
+    auto stop = chrono::steady_clock::now();
+    primes = container.p_size();
+    return (double)chrono::duration_cast<chrono::nanoseconds>(stop - start).count() / (double)values.size();
+}
+
+/**
+ * The shapes of input the sweep feeds the containers with
+ */
+enum class Distribution { Sorted, Reverse, Random, Duplicates, PrimeDense };
+
+const pair<const char*, Distribution> DISTRIBUTIONS[] = {
+        {"sorted", Distribution::Sorted}, {"reverse", Distribution::Reverse}, {"random", Distribution::Random},
+        {"duplicates", Distribution::Duplicates}, {"prime_dense", Distribution::PrimeDense}};
+
+const pair<const char*, StorageLayout> LAYOUTS[] = {
+        {"vector", StorageLayout::Vector}, {"btree", StorageLayout::BTree}, {"tiered", StorageLayout::Tiered},
+        {"partitioned", StorageLayout::Partitioned}};
+
+/**
+ * Every measurement runs WARMUP_RUNS times untimed before its timed repetitions
+ */
+const int WARMUP_RUNS = 1;
+const int REPETITIONS = 5;
+
+/**
+ * @brief Generates the input values for one cell of the sweep
+ * @param distribution The shape of the values
+ * @param size The number of values
+ * @param gen The random generator, seeded once so every run of the benchmark sees the same inputs
+ * @return vector<int> - the values, in the order they are inserted
+ */
+vector<int> makeValues(Distribution distribution, size_type size, mt19937& gen) {
+    uniform_int_distribution<int> wide(0, 1000000000);
+    uniform_int_distribution<int> narrow(0, 15);
+    vector<int> values;
+    values.reserve(size);
+    while (values.size() < size) {
+        switch (distribution) {
+            case Distribution::Duplicates:
+                values.push_back(narrow(gen));
+                break;
+            case Distribution::PrimeDense: {
+                // About 1 in 20 numbers of this size is prime, so this takes ~20 draws per value
+                int value = wide(gen);
+                if (isPrime(value)) {
+                    values.push_back(value);
+                }
+                break;
+            }
+            default:
+                values.push_back(wide(gen));
+                break;
+        }
+    }
+    if (distribution == Distribution::Sorted) {
+        sort(values.begin(), values.end());
+    }
+    if (distribution == Distribution::Reverse) {
+        sort(values.rbegin(), values.rend());
+    }
+    return values;
+}
+
+/**
+ * @brief Nanoseconds elapsed since start
+ */
+double nsSince(chrono::steady_clock::time_point start) {
+    auto stop = chrono::steady_clock::now();
+    return (double)chrono::duration_cast<chrono::nanoseconds>(stop - start).count();
+}
+
+/**
+ * @brief Runs a measurement WARMUP_RUNS times and then REPETITIONS times, and prints one CSV row for it
+ * The row has the median and the fastest repetition in ns per operation, and the median throughput in elements
+ * per second
+ * @param run Does one repetition and returns the nanoseconds its timed part took. Untimed setup stays out of it
+ * @param ops The number of operations (inserts, removes or iterator steps) one repetition does
+ */
+template<typename Run>
+void measure(const char* operation, const char* layout, const char* distribution, size_type ops, Run run) {
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        run();
+    }
+    vector<double> samples;
+    for (int i = 0; i < REPETITIONS; i++) {
+        samples.push_back(run() / (double)max(ops, (size_type)1));
+    }
+    sort(samples.begin(), samples.end());
+    double median = samples[samples.size() / 2];
+    cout << operation << "," << layout << "," << distribution << "," << ops << "," << REPETITIONS << ","
+         << median << "," << samples.front() << "," << (median > 0 ? 1e9 / median : 0) << endl;
+}
+
+/**
+ * @brief A full traversal with the given iterator type
+ * @param checksum Accumulates the visited elements so the traversal can't be optimized away
+ * @return double - the nanoseconds the traversal took
+ */
+template<typename Iterator>
+double traverse(MagicalContainer& container, long& checksum) {
+    Iterator iter(container);
+    auto start = chrono::steady_clock::now();
+    for (auto it = iter.begin(); it != iter.sentinel(); ++it) {
+        checksum += *it;
+    }
+    return nsSince(start);
+}
+
+/**
+ * @brief A full walk in the given order with MagicalContainer::for_each
+ * @param checksum Accumulates the visited elements so the walk can't be optimized away
+ * @return double - the nanoseconds the walk took
+ */
+template<Order order>
+double visit(const MagicalContainer& container, long& checksum) {
+    long sum = 0;
+    auto start = chrono::steady_clock::now();
+    container.for_each<order>([&sum](int elm) { sum += elm; });
+    double elapsed = nsSince(start);
+    checksum += sum;
+    return elapsed;
+}
+
+/**
+ * @brief The regression sweep: addElement, removeElement, a full traversal with every unchecked iterator and a for_each
+ * walk in every order, for every storage layout, input distribution and size
+ * @param max_size The largest size to sweep
+ */
+void benchSweep(mt19937& gen, size_type max_size) {
+    long checksum = 0;
+    cout << "operation,layout,distribution,size,repetitions,median_ns_per_op,min_ns_per_op,elements_per_s" << endl;
+    for (size_type size = 1000; size <= max_size; size *= 10) {
+        for (const auto& distribution : DISTRIBUTIONS) {
+            vector<int> values = makeValues(distribution.second, size, gen);
+            for (const auto& layout : LAYOUTS) {
+                measure("add", layout.first, distribution.first, size, [&]() {
+                    MagicalContainer container(layout.second);
+                    auto start = chrono::steady_clock::now();
+                    for (int value : values) {
+                        container.addElement(value);
+                    }
+                    return nsSince(start);
+                });
+                measure("remove", layout.first, distribution.first, size, [&]() {
+                    MagicalContainer container(layout.second);
+                    container.addElements(std::span<const int>(values));
+                    auto start = chrono::steady_clock::now();
+                    for (int value : values) {
+                        container.removeElement(value);
+                    }
+                    return nsSince(start);
+                });
+
+                MagicalContainer container(layout.second);
+                container.addElements(std::span<const int>(values));
+                measure("ascending", layout.first, distribution.first, size, [&]() {
+                    return traverse<MagicalContainer::UncheckedAscendingIterator>(container, checksum);
+                });
+                measure("side_cross", layout.first, distribution.first, size, [&]() {
+                    return traverse<MagicalContainer::UncheckedSideCrossIterator>(container, checksum);
+                });
+                measure("prime", layout.first, distribution.first, (size_type)container.p_size(), [&]() {
+                    return traverse<MagicalContainer::UncheckedPrimeIterator>(container, checksum);
+                });
+                measure("for_each_ascending", layout.first, distribution.first, size, [&]() {
+                    return visit<Order::Ascending>(container, checksum);
+                });
+                measure("for_each_side_cross", layout.first, distribution.first, size, [&]() {
+                    return visit<Order::SideCross>(container, checksum);
+                });
+                measure("for_each_prime", layout.first, distribution.first, (size_type)container.p_size(), [&]() {
+                    return visit<Order::Prime>(container, checksum);
+                });
+            }
+        }
+    }
+    if (checksum == 0) {
+        cerr << "empty traversals" << endl;
+    }
+}
+
+/**
+ * Every reader thread of the scaling table does TRAVERSALS_PER_THREAD full walks, each under its own ReadGuard
+ */
+const int TRAVERSALS_PER_THREAD = 20;
+
+/**
+ * @brief One full walk of a view, for the reader threads
+ */
+template<typename View>
+long walk(View view) {
+    long sum = 0;
+    for (int elm : view) {
+        sum += elm;
+    }
+    return sum;
+}
+
+/**
+ * @brief Reader scaling of ConcurrentMagicalContainer: 1 to 64 threads walk one shared container in every order,
+ * alone and next to a writer thread that keeps adding and removing elements. Each row has the wall time, the
+ * elements all the readers visited per second, its speedup over one reader, and how many writes got in meanwhile
+ * @param size The number of elements in the container
+ */
+void benchThreads(mt19937& gen, size_type size) {
+    vector<int> values = makeValues(Distribution::Random, size, gen);
+    ConcurrentMagicalContainer container;
+    container.addElements(std::span<const int>(values));
+    atomic<long> checksum(0);
+
+    cout << "operation,threads,writer,size,traversals,ms,elements_per_s,speedup,writes" << endl;
+    for (Order order : {Order::Ascending, Order::Prime, Order::SideCross}) {
+        const char* operation = order == Order::Ascending ? "ascending"
+                              : order == Order::Prime   ? "prime"
+                                                        : "side_cross";
+        for (bool writer : {false, true}) {
+            double single = 0;
+            for (int threads = 1; threads <= 64; threads *= 2) {
+                atomic<bool> done(false);
+                atomic<long> visited(0);
+                long writes = 0;
+                thread mutator;
+                if (writer) {
+                    mutator = thread([&container, &done, &writes]() {
+                        for (int elm = -1; !done.load(); elm--) {
+                            container.addElement(elm);
+                            container.removeElement(elm);
+                            writes += 2;
+                        }
+                    });
+                }
+                vector<thread> readers;
+                auto start = chrono::steady_clock::now();
+                for (int t = 0; t < threads; t++) {
+                    readers.emplace_back([&container, &checksum, &visited, order]() {
+                        for (int i = 0; i < TRAVERSALS_PER_THREAD; i++) {
+                            ConcurrentMagicalContainer::ReadGuard guard = container.read();
+                            long sum = 0;
+                            switch (order) {
+                                case Order::Ascending:
+                                    sum = walk(guard.ascending());
+                                    break;
+                                case Order::Prime:
+                                    sum = walk(guard.primes());
+                                    break;
+                                case Order::SideCross:
+                                    sum = walk(guard.side_cross());
+                                    break;
+                            }
+                            visited += order == Order::Prime ? guard.container().p_size() : guard.container().size();
+                            checksum += sum;
+                        }
+                    });
+                }
+                for (thread& reader : readers) {
+                    reader.join();
+                }
+                double elapsed = nsSince(start);
+                done.store(true);
+                if (mutator.joinable()) {
+                    mutator.join();
+                }
+                double rate = (double)visited.load() * 1e9 / elapsed;
+                if (threads == 1) {
+                    single = rate;
+                }
+                cout << operation << "," << threads << "," << (writer ? "yes" : "no") << "," << size << ","
+                     << threads * TRAVERSALS_PER_THREAD << "," << elapsed / 1e6 << "," << rate << ","
+                     << rate / single << "," << writes << endl;
+            }
+        }
+    }
+    if (checksum.load() == 0) {
+        cerr << "empty traversals" << endl;
+    }
+}
+
+/**
+ * @brief The latency of reader traversals next to a writer that writes in bursts
+ * @param container A ConcurrentMagicalContainer or a SnapshotMagicalContainer, filled by the caller
+ * @param pin Takes a ReadGuard or a Snapshot of the container
+ * @param writes Set to the number of writes that got in while the readers ran
+ * @return vector<double> - the nanoseconds every traversal took, from taking the guard to the end of the walk
+ */
+template<typename Container, typename Pin>
+vector<double> burstLatencies(Container& container, Pin pin, int readers, long& writes, atomic<long>& checksum) {
+    atomic<bool> done(false);
+    writes = 0;
+    thread mutator([&container, &done, &writes]() {
+        for (int elm = -1; !done.load(); elm--) {
+            // A burst of 16 writes, then a pause
+            for (int i = 0; i < 8; i++) {
+                container.addElement(elm);
+                container.removeElement(elm);
+            }
+            writes += 16;
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    });
+    vector<vector<double>> samples((size_type)readers);
+    vector<thread> threads;
+    for (size_type r = 0; r < (size_type)readers; r++) {
+        threads.emplace_back([&container, &pin, &checksum, &samples, r]() {
+            for (int i = 0; i < TRAVERSALS_PER_THREAD * 5; i++) {
+                auto start = chrono::steady_clock::now();
+                auto guard = pin(container);
+                checksum += walk(guard.ascending());
+                samples[r].push_back(nsSince(start));
+            }
+        });
+    }
+    for (thread& reader : threads) {
+        reader.join();
+    }
+    done.store(true);
+    mutator.join();
+    vector<double> latencies;
+    for (const auto& reader : samples) {
+        latencies.insert(latencies.end(), reader.begin(), reader.end());
+    }
+    return latencies;
+}
+
+/**
+ * @brief Reader tail latency under write bursts, the reader-writer lock of ConcurrentMagicalContainer against the
+ * snapshots of SnapshotMagicalContainer, whose readers never wait for a writer
+ * @param size The number of elements in the container
+ */
+void benchLatency(mt19937& gen, size_type size) {
+    vector<int> values = makeValues(Distribution::Random, size, gen);
+    ConcurrentMagicalContainer locked;
+    locked.addElements(std::span<const int>(values));
+    SnapshotMagicalContainer snapshots;
+    snapshots.addElements(std::span<const int>(values));
+    atomic<long> checksum(0);
+
+    cout << "mode,readers,size,traversals,p50_us,p99_us,max_us,writes" << endl;
+    for (int readers : {1, 4, 16}) {
+        for (bool snapshot : {false, true}) {
+            long writes = 0;
+            vector<double> latencies =
+                    snapshot ? burstLatencies(snapshots, [](SnapshotMagicalContainer& c) { return c.snapshot(); },
+                                              readers, writes, checksum)
+                             : burstLatencies(locked, [](ConcurrentMagicalContainer& c) { return c.read(); },
+                                              readers, writes, checksum);
+            sort(latencies.begin(), latencies.end());
+            auto percentile = [&latencies](double p) {
+                return latencies[(size_type)(p * (double)(latencies.size() - 1))] / 1e3;
+            };
+            cout << (snapshot ? "snapshot" : "locked") << "," << readers << "," << size << "," << latencies.size()
+                 << "," << percentile(0.5) << "," << percentile(0.99) << "," << latencies.back() / 1e3 << ","
+                 << writes << endl;
+        }
+    }
+    if (checksum.load() == 0) {
+        cerr << "empty traversals" << endl;
+    }
+}
+
+/**
+ * @brief Inserts values from the given number of threads, each taking every threads'th value
+ * @param insert Inserts one value, as insert(int)
+ * @return double - the nanoseconds until the last thread finished
+ */
+template<typename Insert>
+double concurrentInserts(Insert insert, const vector<int>& values, int threads) {
+    vector<thread> writers;
+    auto start = chrono::steady_clock::now();
+    for (size_type t = 0; t < (size_type)threads; t++) {
+        writers.emplace_back([&insert, &values, t, threads]() {
+            for (size_type i = t; i < values.size(); i += (size_type)threads) {
+                insert(values[i]);
+            }
+        });
+    }
+    for (thread& writer : writers) {
+        writer.join();
+    }
+    return nsSince(start);
+}
+
+/**
+ * @brief Writer scaling: 1 to 64 threads insert random values into one container. ConcurrentMagicalContainer's
+ * lock taken for every insert (locked) against its flat combined addElement (combining), its addElementAsync with
+ * the closing flush() counted in (async), and against the per-shard locks of ShardedMagicalContainer (sharded).
+ * The cores column is the machine's hardware threads: the rows past it only measure contention, not scaling
+ * @param size The number of values inserted in every row
+ */
+void benchWriters(mt19937& gen, size_type size) {
+    vector<int> values = makeValues(Distribution::Random, size, gen);
+    unsigned int cores = thread::hardware_concurrency();
+    cout << "container,threads,size,ms,writes_per_s,speedup,cores" << endl;
+    for (const string name : {"locked", "combining", "async", "sharded"}) {
+        double single = 0;
+        for (int threads = 1; threads <= 64; threads *= 2) {
+            double elapsed = 0;
+            int count = 0;
+            if (name == "sharded") {
+                ShardedMagicalContainer container;
+                elapsed = concurrentInserts([&container](int elm) { container.addElement(elm); }, values, threads);
+                count = container.size();
+            }
+            else {
+                ConcurrentMagicalContainer container;
+                if (name == "locked") {
+                    elapsed = concurrentInserts([&container](int elm) {
+                        container.write([elm](MagicalContainer& inner) { inner.addElement(elm); });
+                    }, values, threads);
+                }
+                else if (name == "async") {
+                    auto start = chrono::steady_clock::now();
+                    concurrentInserts([&container](int elm) { container.addElementAsync(elm); }, values, threads);
+                    container.flush();
+                    elapsed = nsSince(start);
+                }
+                else {
+                    elapsed = concurrentInserts([&container](int elm) { container.addElement(elm); }, values, threads);
+                }
+                count = container.size();
+            }
+            if ((size_type)count != size) {
+                cerr << "lost writes in " << name << endl;
+            }
+            double rate = (double)size * 1e9 / elapsed;
+            if (threads == 1) {
+                single = rate;
+            }
+            cout << name << "," << threads << "," << size << "," << elapsed / 1e6 << "," << rate << ","
+                 << rate / single << "," << cores << endl;
+        }
+    }
+}
+
+/**
+ * @brief The incremental prime index against the old full rescan, per insert
+ * @return int - 0, or 1 if the two disagree on the number of primes
+ */
+int benchRescan(mt19937& gen) {
+    uniform_int_distribution<int> dist(0, 1000000);
+
+    cout << "size,incremental_ns_per_insert,rescan_ns_per_insert,batch_ns_per_insert" << endl;
+    for (size_type size : {1000UL, 2000UL, 4000UL, 8000UL}) {
+        vector<int> values(size);
+        for (auto& value : values) {
+            value = dist(gen);
+        }
+        int incremental_primes = 0;
+        int rescan_primes = 0;
+        double incremental = nsPerInsert<MagicalContainer>(values, incremental_primes);
+        double rescan = nsPerInsert<RescanContainer>(values, rescan_primes);
+        if (incremental_primes != rescan_primes) {
+            cerr << "prime count mismatch at size " << size << endl;
+            return 1;
+        }
+        auto start = chrono::steady_clock::now();
+        MagicalContainer batch;
+        batch.addElements(std::span<const int>(values));
+        double batched = nsSince(start) / (double)size;
+        if (batch.p_size() != incremental_primes) {
+            cerr << "prime count mismatch at size " << size << endl;
+            return 1;
+        }
+        cout << size << "," << incremental << "," << rescan << "," << batched << endl;
+    }
+    return 0;
+}
+
+/**
+ * Usage: bench [sweep|rescan|threads|latency|writers|all] [max_size]
+ * The threads and latency tables use a container of max_size elements, the writers table inserts max_size values
+ * Every table is printed as CSV with a header row, tables are separated by an empty line
+ */
+int main(int argc, char* argv[]) {
+    mt19937 gen(42);
+    string section = argc > 1 ? argv[1] : "all";
+    size_type max_size = argc > 2 ? stoul(argv[2]) : 100000;
+    if (section != "sweep" && section != "rescan" && section != "threads" && section != "latency" &&
+        section != "writers" && section != "all") {
+        cerr << "usage: " << argv[0] << " [sweep|rescan|threads|latency|writers|all] [max_size]" << endl;
+        return 2;
+    }
+
+    if (section == "rescan" || section == "all") {
+        if (benchRescan(gen) != 0) {
+            return 1;
+        }
+    }
+    if (section == "all") {
+        cout << endl;
+    }
+    if (section == "sweep" || section == "all") {
+        benchSweep(gen, max_size);
+    }
+    if (section == "all") {
+        cout << endl;
+    }
+    if (section == "threads" || section == "all") {
+        benchThreads(gen, max_size);
+    }
+    if (section == "all") {
+        cout << endl;
+    }
+    if (section == "latency" || section == "all") {
+        benchLatency(gen, max_size);
+    }
+    if (section == "all") {
+        cout << endl;
+    }
+    if (section == "writers" || section == "all") {
+        benchWriters(gen, max_size);
+    }
+    return 0;
+}
@@ -1,6 +1,17 @@
 #include "doctest.h"
 #include "sources/MagicalContainer.hpp"
+#include "sources/ConcurrentMagicalContainer.hpp"
+#include "sources/ShardedMagicalContainer.hpp"
+#include "sources/SnapshotMagicalContainer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <ctime>
+#include <iterator>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
 
 using namespace ariel;
 using namespace std;
@@ -597,3 +608,1301 @@ TEST_CASE("operator= throws when iterators are pointing at different containers"
 }
 
 
+
+TEST_CASE("PrimeIterator after inserting before existing primes") {
+    MagicalContainer container;
+    container.addElement(13);
+    container.addElement(7);
+    container.addElement(20);
+    container.addElement(2);
+    container.addElement(1);
+    container.addElement(11);
+
+    MagicalContainer::PrimeIterator it(container);
+    CHECK(*it == 2);
+    ++it;
+    CHECK(*it == 7);
+    ++it;
+    CHECK(*it == 11);
+    ++it;
+    CHECK(*it == 13);
+    ++it;
+    CHECK(it == it.end());
+}
+
+TEST_CASE("Removing elements keeps the PrimeIterator consistent") {
+    MagicalContainer container;
+    for (int i = 1; i <= 10; ++i) {
+        container.addElement(i);
+    }
+
+    SUBCASE("Removing a prime") {
+        container.removeElement(3);
+        MagicalContainer::PrimeIterator it(container);
+        CHECK(*it == 2);
+        ++it;
+        CHECK(*it == 5);
+        ++it;
+        CHECK(*it == 7);
+        ++it;
+        CHECK(it == it.end());
+    }
+
+    SUBCASE("Removing a non prime before the primes") {
+        container.removeElement(1);
+        container.removeElement(4);
+        MagicalContainer::PrimeIterator it(container);
+        CHECK(*it == 2);
+        ++it;
+        CHECK(*it == 3);
+        ++it;
+        CHECK(*it == 5);
+        ++it;
+        CHECK(*it == 7);
+    }
+
+    SUBCASE("Removing a missing element") {
+        CHECK(container.tryRemoveElement(42) == 0);
+        CHECK(container.tryRemoveElement(0) == 0);
+        CHECK(container.tryRemoveElement(5) == 1);
+        CHECK(container.tryRemoveElement(5) == 0);
+        CHECK_THROWS_AS(container.removeElement(5), runtime_error);
+        CHECK(container.size() == 9);
+        CHECK(container.p_size() == 3);
+    }
+}
+
+TEST_CASE("Primality engines") {
+    SUBCASE("Miller-Rabin agrees with trial division") {
+        for (int num = -10; num < 20000; ++num) {
+            REQUIRE(isPrime(num) == isPrimeTrialDivision(num));
+        }
+        for (int num : {2047, 1373653, 25326001, 3215031, 2147483629, 2147483646, 2147483647}) {
+            CHECK(isPrime(num) == isPrimeTrialDivision(num));
+        }
+    }
+
+    SUBCASE("Plugging a primality test into the container") {
+        MagicalContainer container([](int num) { return num % 2 == 0; });
+        container.addElement(1);
+        container.addElement(2);
+        container.addElement(4);
+        MagicalContainer::PrimeIterator it(container);
+        CHECK(*it == 2);
+        ++it;
+        CHECK(*it == 4);
+        CHECK_THROWS_AS(MagicalContainer(nullptr), invalid_argument);
+    }
+}
+
+TEST_CASE("Adding elements in a batch") {
+    MagicalContainer container;
+    container.addElement(4);
+    container.addElement(7);
+
+    SUBCASE("From a span") {
+        vector<int> batch = {13, 1, 7, 2, 9};
+        container.addElements(std::span<const int>(batch));
+        CHECK(container.size() == 7);
+        MagicalContainer::AscendingIterator it(container);
+        for (int expected : {1, 2, 4, 7, 7, 9, 13}) {
+            CHECK(*it == expected);
+            ++it;
+        }
+        CHECK(it == it.end());
+        MagicalContainer::PrimeIterator prime(container);
+        for (int expected : {2, 7, 7, 13}) {
+            CHECK(*prime == expected);
+            ++prime;
+        }
+        CHECK(prime == prime.end());
+    }
+
+    SUBCASE("From an iterator range matches adding one by one") {
+        vector<int> batch = {29, -3, 11, 0, 8, 5};
+        MagicalContainer one_by_one(container);
+        for (int elm : batch) {
+            one_by_one.addElement(elm);
+        }
+        container.addElements(batch.begin(), batch.end());
+        CHECK(container == one_by_one);
+    }
+
+    SUBCASE("A small batch is inserted in place instead of merged") {
+        for (bool lazy : {false, true}) {
+            MagicalContainer large;
+            large.setLazyPrimeIndex(lazy);
+            vector<int> elms(1000);
+            for (size_t i = 0; i < elms.size(); i++) {
+                elms[i] = (int)(2 * i);
+            }
+            large.addElements(std::span<const int>(elms));
+            // The merge leaves no spare capacity, so this insert reallocates once and leaves room for the batch
+            large.addElement(-1);
+            const int* data = &large.at(0);
+            vector<int> batch = {7, 3001};
+            large.addElements(std::span<const int>(batch));
+            CHECK(&large.at(0) == data);
+            CHECK(large.size() == 1003);
+            CHECK(large.at(5) == 7);
+            CHECK(large.at(1002) == 3001);
+            CHECK(large.p_size() == 3);
+        }
+    }
+}
+
+TEST_CASE("Removing elements in a batch") {
+    MagicalContainer container;
+    vector<int> elms = {1, 2, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    container.addElements(std::span<const int>(elms));
+
+    SUBCASE("removeElements removes one occurrence per value") {
+        vector<int> batch = {11, 3, 42, 4, 1};
+        CHECK(container.removeElements(std::span<const int>(batch)) == 4);
+        CHECK(container.size() == 8);
+        MagicalContainer::PrimeIterator it(container);
+        for (int expected : {2, 3, 5, 7}) {
+            CHECK(*it == expected);
+            ++it;
+        }
+        CHECK(it == it.end());
+    }
+
+    SUBCASE("A small batch doesn't sweep the container") {
+        MagicalContainer large;
+        vector<int> values(200000);
+        for (size_t i = 0; i < values.size(); i++) {
+            values[i] = (int)i;
+        }
+        large.addElements(std::span<const int>(values));
+        auto start = chrono::steady_clock::now();
+        CHECK(large.erase_if([](int) { return false; }) == 0);
+        auto sweep = chrono::steady_clock::now() - start;
+        // Removing from the tail shifts almost nothing, so only a sweep makes this cost O(n)
+        vector<int> batch = {199999, 199998, 42};
+        start = chrono::steady_clock::now();
+        CHECK(large.removeElements(std::span<const int>(batch)) == 3);
+        auto small = chrono::steady_clock::now() - start;
+        CHECK(small * 4 < sweep);
+        CHECK(large.size() == 199997);
+        CHECK(large.at(42) == 43);
+    }
+
+    SUBCASE("erase_if matches removing one by one") {
+        MagicalContainer one_by_one(container);
+        for (int elm : {3, 3, 6, 9}) {
+            one_by_one.removeElement(elm);
+        }
+        CHECK(container.erase_if([](int elm) { return elm % 3 == 0; }) == 4);
+        CHECK(container == one_by_one);
+        CHECK(container.erase_if([](int) { return false; }) == 0);
+        CHECK(container.erase_if([](int) { return true; }) == 8);
+        CHECK(container.size() == 0);
+        CHECK(container.p_size() == 0);
+    }
+}
+
+TEST_CASE("Storage layouts behave like the vector layout") {
+    for (StorageLayout layout : {StorageLayout::BTree, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+        MagicalContainer vec;
+        MagicalContainer tree(layout);
+        unsigned int seed = 7;
+        auto next = [&seed]() {
+            seed = seed * 1103515245 + 12345;
+            return (int)((seed >> 8) % 2000);
+        };
+        for (int i = 0; i < 5000; ++i) {
+            int elm = next();
+            vec.addElement(elm);
+            tree.addElement(elm);
+            if (i % 3 == 0) {
+                int victim = next();
+                REQUIRE(vec.tryRemoveElement(victim) == tree.tryRemoveElement(victim));
+            }
+        }
+        CHECK(tree.size() == vec.size());
+        CHECK(tree.p_size() == vec.p_size());
+        CHECK(tree == vec);
+
+        MagicalContainer::AscendingIterator asc(tree);
+        MagicalContainer::SideCrossIterator cross(tree);
+        MagicalContainer::SideCrossIterator vec_cross(vec);
+        for (int i = 0; i < 100; ++i, ++asc, ++cross, ++vec_cross) {
+            CHECK(*asc == vec.at((size_type)i));
+            CHECK(*cross == *vec_cross);
+        }
+
+        vector<int> batch = {5, 3, 1999, 17, 4};
+        tree.addElements(std::span<const int>(batch));
+        vec.addElements(std::span<const int>(batch));
+        CHECK(tree == vec);
+        CHECK(tree.erase_if([](int elm) { return elm % 2 == 0; }) == vec.erase_if([](int elm) { return elm % 2 == 0; }));
+        CHECK(tree == vec);
+
+        MagicalContainer copy(tree);
+        while (copy.size() > 0) {
+            copy.removeElement(copy.at(0));
+        }
+        CHECK(copy.p_size() == 0);
+        CHECK(tree == vec);
+    }
+}
+
+TEST_CASE("PrimeBitmap rank and select") {
+    PrimeBitmap bitmap;
+    vector<bool> bits;
+    unsigned int seed = 3;
+    for (int i = 0; i < 5000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        bool bit = (seed >> 16) % 3 == 0;
+        auto pos = (size_type)((seed >> 4) % (bits.size() + 1));
+        bitmap.insert(pos, bit);
+        bits.insert(bits.begin() + (long)pos, bit);
+        if (i % 4 == 0) {
+            pos = (size_type)((seed >> 8) % bits.size());
+            CHECK(bitmap.erase(pos) == bits[pos]);
+            bits.erase(bits.begin() + (long)pos);
+        }
+    }
+    REQUIRE(bitmap.size() == bits.size());
+    vector<size_type> positions;
+    for (size_type i = 0; i < bits.size(); ++i) {
+        REQUIRE(bitmap.test(i) == bits[i]);
+        REQUIRE(bitmap.rank(i) == positions.size());
+        if (bits[i]) {
+            REQUIRE(bitmap.select(positions.size()) == i);
+            positions.push_back(i);
+        }
+    }
+    size_type ones = positions.size();
+    CHECK(bitmap.count() == ones);
+    for (size_type k = ones; k-- > 0;) {
+        REQUIRE(bitmap.select(k) == positions[k]);
+    }
+    CHECK_THROWS_AS(bitmap.select(ones), out_of_range);
+    CHECK(bitmap.memoryUsage() < bits.size() / 8 + bits.size() / 16 + 64);
+}
+
+static int lazy_prime_tests = 0;
+
+TEST_CASE("Lazy prime index") {
+    lazy_prime_tests = 0;
+    MagicalContainer lazy([](int num) { lazy_prime_tests++; return isPrime(num); });
+    MagicalContainer eager;
+    lazy.setLazyPrimeIndex(true);
+    CHECK(lazy.lazyPrimeIndex());
+    unsigned int seed = 11;
+    for (int i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int elm = (int)((seed >> 8) % 500);
+        lazy.addElement(elm);
+        eager.addElement(elm);
+        if (i % 3 == 0) {
+            CHECK(lazy.tryRemoveElement(elm / 2) == eager.tryRemoveElement(elm / 2));
+        }
+    }
+    CHECK(lazy_prime_tests == 0);
+    CHECK(lazy.size() == eager.size());
+
+    CHECK(lazy.p_size() == eager.p_size());
+    int rebuilt = lazy_prime_tests;
+    CHECK(rebuilt == lazy.size());
+    CHECK(lazy == eager);
+    CHECK(lazy_prime_tests == rebuilt);
+
+    // Writing past the middle leaves the bits before it alone
+    lazy.addElement(1000);
+    eager.addElement(1000);
+    vector<int> batch = {999, 498, 2003};
+    lazy.addElements(std::span<const int>(batch));
+    eager.addElements(std::span<const int>(batch));
+    CHECK(lazy.erase_if([](int elm) { return elm == 499; }) == eager.erase_if([](int elm) { return elm == 499; }));
+    MagicalContainer::PrimeIterator lazy_it(lazy);
+    MagicalContainer::PrimeIterator eager_it(eager);
+    for (int i = 0; i < eager.p_size(); ++i, ++lazy_it, ++eager_it) {
+        REQUIRE(*lazy_it == *eager_it);
+    }
+    CHECK(lazy_prime_tests - rebuilt < 20);
+
+    lazy.removeElement(lazy.at(0));
+    eager.removeElement(eager.at(0));
+    lazy.setLazyPrimeIndex(false);
+    CHECK(lazy == eager);
+    MagicalContainer tree(StorageLayout::BTree);
+    CHECK_THROWS_AS(tree.setLazyPrimeIndex(true), invalid_argument);
+}
+
+/**
+ * The best of a few rounds of assigning and comparing iterators of the container, in nanoseconds
+ */
+template<typename Iterator>
+static long iteratorOpsTime(MagicalContainer& container) {
+    long best = -1;
+    for (int round = 0; round < 5; ++round) {
+        Iterator first(container);
+        Iterator second(container);
+        ++second;
+        int equal = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 20000; ++i) {
+            first = second;
+            equal += (first == second) ? 1 : 0;
+            Iterator copy(first);
+            equal += (copy != second) ? 1 : 0;
+        }
+        auto elapsed = (long)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        REQUIRE(equal == 20000);
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+TEST_CASE("Iterator operations don't scale with the container") {
+    MagicalContainer small;
+    MagicalContainer large;
+    vector<int> values;
+    for (int i = 0; i < 200000; ++i) {
+        values.push_back(i);
+    }
+    small.addElements(std::span<const int>(values.data(), 100));
+    large.addElements(std::span<const int>(values));
+
+    // A deep compare or copy would make the large container ~2000 times slower, the bound leaves room for noise
+    CHECK(iteratorOpsTime<MagicalContainer::AscendingIterator>(large) <
+          20 * iteratorOpsTime<MagicalContainer::AscendingIterator>(small) + 1000000);
+    CHECK(iteratorOpsTime<MagicalContainer::PrimeIterator>(large) <
+          20 * iteratorOpsTime<MagicalContainer::PrimeIterator>(small) + 1000000);
+    CHECK(iteratorOpsTime<MagicalContainer::SideCrossIterator>(large) <
+          20 * iteratorOpsTime<MagicalContainer::SideCrossIterator>(small) + 1000000);
+
+    MagicalContainer::AscendingIterator it(large);
+    MagicalContainer::AscendingIterator other(large);
+    ++other;
+    it = other;
+    CHECK(*it == 1);
+    CHECK(large.size() == 200000);
+}
+
+TEST_CASE("SideCrossIterator random access") {
+    for (int count : {0, 1, 2, 7, 10}) {
+        MagicalContainer container;
+        for (int i = 1; i <= count; ++i) {
+            container.addElement(i * 10);
+        }
+        vector<int> walked;
+        MagicalContainer::SideCrossIterator it(container);
+        for (auto step = it.begin(); step != it.end(); ++step) {
+            walked.push_back(*step);
+        }
+        REQUIRE(walked.size() == (size_type)count);
+        CHECK(it.end() - it.begin() == count);
+        for (int k = 0; k < count; ++k) {
+            CHECK(it[k] == walked[(size_type)k]);
+            CHECK(*(it.begin() + k) == walked[(size_type)k]);
+            MagicalContainer::SideCrossIterator moved(container);
+            moved += k;
+            CHECK(*moved == walked[(size_type)k]);
+            CHECK(moved - it == k);
+            CHECK((k == 0 || it < moved));
+            CHECK((k == 0 || moved > it));
+        }
+        CHECK_THROWS_AS(it += count + 1, out_of_range);
+        CHECK_THROWS_AS(it[count], out_of_range);
+        CHECK_THROWS_AS(it + (-1), out_of_range);
+    }
+}
+
+static_assert(std::random_access_iterator<MagicalContainer::AscendingIterator>);
+static_assert(std::random_access_iterator<MagicalContainer::PrimeIterator>);
+static_assert(std::random_access_iterator<MagicalContainer::SideCrossIterator>);
+
+TEST_CASE("Iterators work with the standard algorithms") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+        MagicalContainer container(layout);
+        for (int i = 1; i <= 100; ++i) {
+            container.addElement(i);
+        }
+        MagicalContainer::AscendingIterator asc(container);
+        MagicalContainer::PrimeIterator primes(container);
+        MagicalContainer::SideCrossIterator cross(container);
+
+        CHECK(std::distance(asc.begin(), asc.end()) == 100);
+        CHECK(std::distance(primes.begin(), primes.end()) == 25);
+        CHECK(std::distance(cross.begin(), cross.end()) == 100);
+
+        // The first prime >= 50 by binary search over the primes
+        auto first = std::lower_bound(primes.begin(), primes.end(), 50);
+        CHECK(*first == 53);
+        CHECK(first - primes.begin() == 15);
+        CHECK(std::binary_search(asc.begin(), asc.end(), 77));
+        CHECK(std::ranges::is_sorted(asc.begin(), asc.end()));
+
+        auto it = asc.begin();
+        std::advance(it, 10);
+        CHECK(*it == 11);
+        CHECK(*it-- == 11);
+        CHECK(*--it == 9);
+        CHECK(it[2] == 11);
+        CHECK(*(3 + it) == 12);
+        it -= 8;
+        CHECK(it == asc.begin());
+        CHECK(it <= asc.begin());
+        CHECK(asc.end() >= it);
+        CHECK_THROWS_AS(--it, runtime_error);
+        CHECK_THROWS_AS(it - 1, out_of_range);
+
+        auto last_cross = cross.end() - 1;
+        CHECK(*last_cross == 51);
+        CHECK(*(primes.end() - 1) == 97);
+
+        vector<int> reversed(std::reverse_iterator(asc.end()), std::reverse_iterator(asc.begin()));
+        CHECK(reversed.front() == 100);
+        CHECK(reversed.back() == 1);
+
+        MagicalContainer::PrimeIterator unbound;
+        unbound = primes.begin() + 1;
+        CHECK(*unbound == 3);
+        unbound = std::move(first);
+        CHECK(*unbound == 53);
+    }
+}
+
+static_assert(std::sized_sentinel_for<MagicalContainer::AscendingIterator::Sentinel, MagicalContainer::AscendingIterator>);
+static_assert(std::sized_sentinel_for<MagicalContainer::PrimeIterator::Sentinel, MagicalContainer::PrimeIterator>);
+static_assert(std::sized_sentinel_for<MagicalContainer::SideCrossIterator::Sentinel, MagicalContainer::SideCrossIterator>);
+
+TEST_CASE("Iterating up to a sentinel") {
+    MagicalContainer container;
+    for (int i = 1; i <= 20; ++i) {
+        container.addElement(i);
+    }
+    MagicalContainer::AscendingIterator asc(container);
+    MagicalContainer::PrimeIterator primes(container);
+    MagicalContainer::SideCrossIterator cross(container);
+
+    int sum = 0;
+    for (auto it = asc.begin(); it != asc.sentinel(); ++it) {
+        sum += *it;
+    }
+    CHECK(sum == 210);
+    vector<int> prime_values;
+    for (auto it = primes.begin(); it != primes.sentinel(); ++it) {
+        prime_values.push_back(*it);
+    }
+    CHECK(prime_values == vector<int>{2, 3, 5, 7, 11, 13, 17, 19});
+    CHECK(std::ranges::distance(cross.begin(), cross.sentinel()) == 20);
+    CHECK(primes.sentinel() - primes.begin() == 8);
+    CHECK(asc.begin() - asc.sentinel() == -20);
+    CHECK(asc.end() == asc.sentinel());
+    CHECK(asc.sentinel() != asc.begin());
+    CHECK(*std::ranges::find(cross.begin(), cross.sentinel(), 19) == 19);
+}
+
+TEST_CASE("Unchecked iterators") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree, StorageLayout::Tiered,
+                                 StorageLayout::Partitioned}) {
+        MagicalContainer container(layout);
+        for (int i = 0; i < 500; ++i) {
+            container.addElement((i * 37) % 311);
+        }
+        CHECK(std::ranges::equal(container.ascending<Unchecked>(), container.ascending()));
+        CHECK(std::ranges::equal(container.primes<Unchecked>(), container.primes()));
+        CHECK(std::ranges::equal(container.side_cross<Unchecked>(), container.side_cross()));
+
+        MagicalContainer::UncheckedAscendingIterator asc(container);
+        MagicalContainer::UncheckedPrimeIterator primes(container);
+        MagicalContainer::UncheckedSideCrossIterator cross(container);
+        MagicalContainer::SideCrossIterator checked_cross(container);
+        size_type index = 0;
+        for (auto it = asc.begin(); it != asc.sentinel(); ++it, ++index) {
+            REQUIRE(*it == container.at(index));
+        }
+        CHECK(index == (size_type)container.size());
+        index = 0;
+        for (auto it = primes.begin(); it != primes.sentinel(); ++it, ++index) {
+            REQUIRE(*it == container.p_value(index));
+        }
+        CHECK(index == (size_type)container.p_size());
+        auto checked = checked_cross.begin();
+        for (auto it = cross.begin(); it != cross.sentinel(); ++it, ++checked) {
+            REQUIRE(*it == *checked);
+        }
+        CHECK(checked == checked_cross.end());
+        CHECK(cross.begin()[1] == container.at((size_type)container.size() - 1));
+
+        // Random access goes through the same unchecked reads
+        auto asc_begin = asc.begin();
+        auto prime_begin = primes.begin();
+        auto cross_begin = cross.begin();
+        auto checked_begin = checked_cross.begin();
+        for (std::ptrdiff_t k = 0; k < container.size(); k += 13) {
+            REQUIRE(asc_begin[k] == container.at((size_type)k));
+            REQUIRE(*(asc.end() - (container.size() - k)) == container.at((size_type)k));
+            REQUIRE(cross_begin[k] == checked_begin[k]);
+        }
+        for (std::ptrdiff_t k = 0; k < container.p_size(); k += 7) {
+            REQUIRE(prime_begin[k] == container.p_value((size_type)k));
+            REQUIRE(*(prime_begin + k) == prime_begin[k]);
+        }
+    }
+
+    // Moving an unchecked iterator out of the container doesn't throw, as long as it isn't dereferenced there
+    MagicalContainer small;
+    small.addElement(2);
+    MagicalContainer::UncheckedAscendingIterator small_asc(small);
+    MagicalContainer::UncheckedPrimeIterator small_primes(small);
+    MagicalContainer::UncheckedSideCrossIterator small_cross(small);
+    CHECK_NOTHROW(MagicalContainer::UncheckedAscendingIterator(small, 5));
+    CHECK_NOTHROW(MagicalContainer::UncheckedPrimeIterator(small, 5));
+    CHECK_NOTHROW(MagicalContainer::UncheckedSideCrossIterator(small, 5));
+    auto asc_it = small_asc.begin();
+    asc_it += 5;
+    asc_it -= 6;
+    ++asc_it;
+    CHECK(*asc_it == 2);
+    auto prime_it = small_primes.begin();
+    --prime_it;
+    prime_it += 1;
+    CHECK(*prime_it == 2);
+    auto cross_it = small_cross.begin() + 3;
+    cross_it = cross_it - 3;
+    CHECK(*cross_it == 2);
+    MagicalContainer::AscendingIterator checked_asc(small);
+    CHECK_THROWS_AS(MagicalContainer::AscendingIterator(small, 5), out_of_range);
+    CHECK_THROWS_AS(checked_asc += 5, out_of_range);
+    CHECK_THROWS_AS(--checked_asc, runtime_error);
+    CHECK_THROWS_AS(checked_asc[1], out_of_range);
+
+    // The checked iterators keep throwing past the end in the same program
+    MagicalContainer container;
+    container.addElement(3);
+    MagicalContainer::PrimeIterator primes(container);
+    auto end = primes.end();
+    CHECK_THROWS_AS(*end, out_of_range);
+    CHECK_THROWS_AS(++end, runtime_error);
+}
+
+TEST_CASE("Iterator position constructors") {
+    MagicalContainer container;
+    for (int i = 1; i <= 10; ++i) {
+        container.addElement(i);
+    }
+    CHECK(*MagicalContainer::AscendingIterator(container, 3) == 4);
+    CHECK(*MagicalContainer::SideCrossIterator(container, 1) == 10);
+    CHECK(*MagicalContainer::PrimeIterator(container, 2) == 5);
+    CHECK(MagicalContainer::PrimeIterator(container, 4) == MagicalContainer::PrimeIterator(container).end());
+    CHECK(MagicalContainer::AscendingIterator(container, 10) == MagicalContainer::AscendingIterator(container).end());
+
+    // A prime position is bounded by the number of primes (4), not by the number of elements (10)
+    CHECK_THROWS_AS(MagicalContainer::PrimeIterator(container, 5), out_of_range);
+    CHECK_THROWS_AS(MagicalContainer::PrimeIterator(container, 10), out_of_range);
+    CHECK_THROWS_AS(MagicalContainer::PrimeIterator(container, -1), out_of_range);
+    CHECK_THROWS_AS(MagicalContainer::AscendingIterator(container, 11), out_of_range);
+    CHECK_THROWS_AS(MagicalContainer::SideCrossIterator(container, 11), out_of_range);
+}
+
+static_assert(!std::is_same_v<MagicalContainer::AscendingIterator, MagicalContainer::UncheckedAscendingIterator>);
+static_assert(std::ranges::random_access_range<MagicalContainer::BasicPrimeView<Unchecked>>);
+static_assert(std::ranges::view<MagicalContainer::AscendingView>);
+static_assert(std::ranges::sized_range<MagicalContainer::PrimeView>);
+static_assert(std::ranges::random_access_range<MagicalContainer::SideCrossView>);
+
+TEST_CASE("Views over the three orders") {
+    MagicalContainer container;
+    for (int i = 1; i <= 30; ++i) {
+        container.addElement(i);
+    }
+    auto asc = container.ascending();
+    auto primes = container.primes();
+    auto cross = container.side_cross();
+    CHECK(std::ranges::size(asc) == 30);
+    CHECK(std::ranges::size(primes) == 10);
+    CHECK(std::ranges::size(cross) == 30);
+    CHECK(asc[4] == 5);
+    CHECK(primes[9] == 29);
+    CHECK(cross[1] == 30);
+
+    vector<int> squares;
+    for (int square : primes | std::views::filter([](int prime) { return prime % 4 == 1; })
+                             | std::views::transform([](int prime) { return prime * prime; })
+                             | std::views::take(3)) {
+        squares.push_back(square);
+    }
+    CHECK(squares == vector<int>{25, 169, 289});
+
+    vector<int> tail;
+    for (int elm : cross | std::views::drop(26)) {
+        tail.push_back(elm);
+    }
+    CHECK(tail == vector<int>{14, 17, 15, 16});
+    CHECK(std::ranges::max(asc | std::views::take(7)) == 7);
+
+    MagicalContainer tree(StorageLayout::BTree);
+    tree.addElements(std::span<const int>(vector<int>{9, 2, 7, 4}));
+    int sum = 0;
+    for (int elm : tree.ascending()) {
+        sum += elm;
+    }
+    CHECK(sum == 22);
+    CHECK(std::ranges::equal(tree.primes(), vector<int>{2, 7}));
+}
+
+TEST_CASE("Reading the container in chunks") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+        MagicalContainer container(layout);
+        vector<int> values;
+        for (int i = 0; i < 3000; ++i) {
+            values.push_back((i * 7919) % 3001);
+        }
+        container.addElements(std::span<const int>(values));
+        vector<int> buffer(64);
+
+        for (Order order : {Order::Ascending, Order::Prime, Order::SideCross}) {
+            vector<int> expected;
+            if (order == Order::Ascending) {
+                std::ranges::copy(container.ascending(), std::back_inserter(expected));
+            }
+            else if (order == Order::Prime) {
+                std::ranges::copy(container.primes(), std::back_inserter(expected));
+            }
+            else {
+                std::ranges::copy(container.side_cross(), std::back_inserter(expected));
+            }
+            vector<int> read;
+            auto reader = container.chunks(order, 100, buffer);
+            for (auto block = reader.next(); !block.empty(); block = reader.next()) {
+                REQUIRE(block.size() <= 100);
+                if (order != Order::Ascending) {
+                    REQUIRE(block.size() <= buffer.size());
+                }
+                read.insert(read.end(), block.begin(), block.end());
+            }
+            CHECK(read == expected);
+        }
+    }
+
+    MagicalContainer container;
+    container.addElements(std::span<const int>(vector<int>{5, 1, 4}));
+    auto reader = container.chunks(Order::Ascending, 10);
+    auto block = reader.next();
+    CHECK(block.size() == 3);
+    CHECK(block.data() == &container.at(0));
+    CHECK(reader.next().empty());
+    CHECK_THROWS_AS(container.chunks(Order::Prime, 10), invalid_argument);
+    CHECK_THROWS_AS(container.chunks(Order::Ascending, 0), invalid_argument);
+}
+
+TEST_CASE("Internal iteration with for_each") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+        MagicalContainer container(layout);
+        vector<int> values;
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back((i * 389) % 1009);
+        }
+        container.addElements(std::span<const int>(values));
+        container.addElement(17);
+
+        vector<int> expected;
+        vector<int> visited;
+        std::ranges::copy(container.ascending(), std::back_inserter(expected));
+        container.for_each<Order::Ascending>([&visited](int elm) { visited.push_back(elm); });
+        CHECK(visited == expected);
+
+        expected.clear();
+        visited.clear();
+        std::ranges::copy(container.primes(), std::back_inserter(expected));
+        container.for_each<Order::Prime>([&visited](int elm) { visited.push_back(elm); });
+        CHECK(visited == expected);
+
+        expected.clear();
+        visited.clear();
+        std::ranges::copy(container.side_cross(), std::back_inserter(expected));
+        container.for_each<Order::SideCross>([&visited](int elm) { visited.push_back(elm); });
+        CHECK(visited == expected);
+    }
+
+    MagicalContainer lazy;
+    lazy.setLazyPrimeIndex(true);
+    lazy.addElements(std::span<const int>(vector<int>{4, 3, 9, 7}));
+    long sum = 0;
+    lazy.for_each<Order::Prime>([&sum](int elm) { sum += elm; });
+    CHECK(sum == 10);
+}
+
+TEST_CASE("Materialized primes") {
+    MagicalContainer plain;
+    MagicalContainer materialized;
+    materialized.setMaterializedPrimes(true);
+    CHECK(materialized.materializedPrimes());
+    unsigned int seed = 5;
+    for (int i = 0; i < 3000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int elm = (int)((seed >> 8) % 2000);
+        plain.addElement(elm);
+        materialized.addElement(elm);
+        if (i % 4 == 0) {
+            CHECK(plain.tryRemoveElement(elm + 1) == materialized.tryRemoveElement(elm + 1));
+        }
+    }
+    vector<int> batch = {3, 5, 1999, 1000};
+    plain.addElements(std::span<const int>(batch));
+    materialized.addElements(std::span<const int>(batch));
+    CHECK(plain.erase_if([](int elm) { return elm % 10 == 7; }) ==
+          materialized.erase_if([](int elm) { return elm % 10 == 7; }));
+    CHECK(plain == materialized);
+    REQUIRE(plain.p_size() == materialized.p_size());
+    for (size_type k = 0; k < (size_type)plain.p_size(); ++k) {
+        REQUIRE(materialized.p_value(k) == plain.p_value(k));
+        REQUIRE(plain.p_value(k) == plain.at((size_type)plain.p_at(k)));
+    }
+    CHECK(std::ranges::equal(plain.primes(), materialized.primes()));
+    CHECK_THROWS_AS(materialized.p_value((size_type)materialized.p_size()), out_of_range);
+
+    auto reader = materialized.chunks(Order::Prime, 1 << 20, std::span<int>());
+    auto block = reader.next();
+    CHECK(block.size() == (size_type)plain.p_size());
+    CHECK(block.data() == &materialized.p_value(0));
+    // [] reads the materialized copy like *, not the element it was copied from
+    MagicalContainer::PrimeIterator prime_begin(materialized);
+    for (std::ptrdiff_t k = 0; k < materialized.p_size(); k += 11) {
+        REQUIRE(&prime_begin[k] == &*(prime_begin + k));
+        REQUIRE(&prime_begin[k] == &materialized.p_value((size_type)k));
+    }
+    CHECK(materialized.primeIndexMemory() >= plain.primeIndexMemory() + block.size() * sizeof(int));
+
+    // The materialized primes follow the dirty range of the lazy prime index too
+    materialized.setLazyPrimeIndex(true);
+    plain.setLazyPrimeIndex(true);
+    for (int elm : {2, 1997, 1500, 3}) {
+        plain.addElement(elm);
+        materialized.addElement(elm);
+    }
+    materialized.removeElement(1997);
+    plain.removeElement(1997);
+    CHECK(std::ranges::equal(plain.primes(), materialized.primes()));
+    size_type with_copy = materialized.primeIndexMemory();
+    materialized.setMaterializedPrimes(false);
+    CHECK(materialized.primeIndexMemory() + (size_type)materialized.p_size() * sizeof(int) <= with_copy);
+
+    for (StorageLayout layout : {StorageLayout::BTree, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+        MagicalContainer container(layout);
+        container.addElements(std::span<const int>(batch));
+        container.addElement(7);
+        CHECK(container.p_value(0) == 3);
+        CHECK(container.p_value(3) == 1999);
+        MagicalContainer::PrimeIterator primes(container);
+        CHECK(&primes[2] == &*(primes + 2));
+        CHECK(&primes[2] == &container.p_value(2));
+        CHECK_THROWS_AS(primes[4], out_of_range);
+        CHECK_THROWS_AS(container.setMaterializedPrimes(true), invalid_argument);
+    }
+}
+
+TEST_CASE("Concurrent readers and a writer") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree, StorageLayout::Tiered,
+                                 StorageLayout::Partitioned}) {
+        for (bool lazy : {false, true}) {
+            if (lazy && layout != StorageLayout::Vector) {
+                continue;
+            }
+            ConcurrentMagicalContainer container(layout);
+            if (lazy) {
+                container.setLazyPrimeIndex(true);
+            }
+            vector<int> initial;
+            for (int elm = 0; elm < 3000; elm += 3) {
+                initial.push_back(elm);
+            }
+            container.addElements(std::span<const int>(initial));
+
+            // The readers check invariants that only hold if no write is half done while they walk
+            atomic<bool> done(false);
+            atomic<int> failures(0);
+            vector<thread> readers;
+            for (int r = 0; r < 4; ++r) {
+                readers.emplace_back([&container, &done, &failures]() {
+                    while (!done.load()) {
+                        ConcurrentMagicalContainer::ReadGuard guard = container.read();
+                        const MagicalContainer& snapshot = guard.container();
+                        auto ascending = guard.ascending();
+                        auto primes = guard.primes();
+                        if (!std::ranges::is_sorted(ascending) || ascending.size() != (size_type)snapshot.size() ||
+                            primes.size() != (size_type)snapshot.p_size() ||
+                            !std::ranges::all_of(primes, [](int elm) { return isPrime(elm); }) ||
+                            std::ranges::distance(guard.side_cross()) != snapshot.size()) {
+                            failures++;
+                        }
+                    }
+                });
+            }
+            thread writer([&container]() {
+                for (int i = 0; i < 300; ++i) {
+                    container.addElement(3000 + i);
+                    container.tryRemoveElement(3 * i);
+                    if (i % 50 == 0) {
+                        container.write([](MagicalContainer& inner) { return inner.erase_if([](int elm) {
+                            return elm % 7 == 1;
+                        }); });
+                    }
+                }
+            });
+            writer.join();
+            done.store(true);
+            for (thread& reader : readers) {
+                reader.join();
+            }
+            CHECK(failures.load() == 0);
+
+            MagicalContainer expected;
+            for (int elm : initial) {
+                expected.addElement(elm);
+            }
+            for (int i = 0; i < 300; ++i) {
+                expected.addElement(3000 + i);
+                expected.tryRemoveElement(3 * i);
+                if (i % 50 == 0) {
+                    expected.erase_if([](int elm) { return elm % 7 == 1; });
+                }
+            }
+            MagicalContainer copy = container.snapshot();
+            CHECK(copy == expected);
+            CHECK(container.size() == expected.size());
+            CHECK(container.p_size() == expected.p_size());
+            CHECK(container.at(0) == expected.at(0));
+            CHECK(container.p_value(1) == expected.p_value(1));
+            long sum = 0;
+            container.for_each<Order::Prime>([&sum](int elm) { sum += elm; });
+            long expected_sum = 0;
+            expected.for_each<Order::Prime>([&expected_sum](int elm) { expected_sum += elm; });
+            CHECK(sum == expected_sum);
+            CHECK_THROWS_AS(container.removeElement(-1), runtime_error);
+        }
+    }
+}
+
+TEST_CASE("Combined writes from many threads") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree}) {
+        ConcurrentMagicalContainer container(layout);
+        atomic<int> sevens_removed(0);
+        vector<thread> writers;
+        for (int w = 0; w < 8; ++w) {
+            writers.emplace_back([&container, &sevens_removed, w]() {
+                container.addElement(7);
+                for (int i = 0; i < 300; ++i) {
+                    container.addElement(w * 10000 + i);
+                    if (i % 3 == 0) {
+                        container.removeElement(w * 10000 + i / 2);
+                    }
+                }
+                // Sixteen removes race for eight sevens, so exactly eight of them find one
+                sevens_removed += container.tryRemoveElement(7);
+                sevens_removed += container.tryRemoveElement(7);
+            });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        CHECK(sevens_removed.load() == 8);
+        CHECK_THROWS_AS(container.removeElement(7), runtime_error);
+
+        MagicalContainer expected;
+        for (int w = 0; w < 8; ++w) {
+            for (int i = 0; i < 300; ++i) {
+                expected.addElement(w * 10000 + i);
+                if (i % 3 == 0) {
+                    expected.removeElement(w * 10000 + i / 2);
+                }
+            }
+        }
+        MagicalContainer copy = container.snapshot();
+        CHECK(copy == expected);
+
+        // Writes that pile up behind a reader are applied as one batch when it leaves
+        vector<int> batch_removed(6, -1);
+        {
+            ConcurrentMagicalContainer::ReadGuard guard = container.read();
+            writers.clear();
+            for (int w = 0; w < 6; ++w) {
+                writers.emplace_back([&container, &batch_removed, w]() {
+                    // Two removes for each of three elements
+                    batch_removed[(size_type)w] = container.tryRemoveElement(10000 * (w % 3) + 299);
+                    container.addElement(-5 - w % 2);
+                });
+            }
+            this_thread::sleep_for(chrono::milliseconds(10));
+            // The writers wait for the reader asleep: the process uses next to no CPU time while it holds on
+            std::clock_t cpu = std::clock();
+            this_thread::sleep_for(chrono::milliseconds(50));
+            CHECK(std::clock() - cpu < CLOCKS_PER_SEC / 100);
+            CHECK(guard.container().size() == expected.size());
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        for (size_type w = 0; w < 3; ++w) {
+            CHECK(batch_removed[w] + batch_removed[w + 3] == 1);
+        }
+        CHECK(container.size() == expected.size() + 3);
+        CHECK(container.at(0) == -6);
+        CHECK(container.at(2) == -6);
+        CHECK(container.at(3) == -5);
+    }
+}
+
+TEST_CASE("A producer waits for room in the ring asleep") {
+    ConcurrentMagicalContainer container;
+    atomic<int> pushed(0);
+    thread producer;
+    {
+        // The merger can't take the lock while this reader holds it, so the ring fills up and stays full
+        ConcurrentMagicalContainer::ReadGuard guard = container.read();
+        producer = thread([&container, &pushed]() {
+            for (int i = 0; i < 100000; ++i) {
+                container.addElementAsync(i);
+                pushed.store(i + 1);
+            }
+        });
+        while (pushed.load() < 65536) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+        CHECK(pushed.load() < 100000);
+        std::clock_t cpu = std::clock();
+        this_thread::sleep_for(chrono::milliseconds(50));
+        CHECK(std::clock() - cpu < CLOCKS_PER_SEC / 100);
+        CHECK(guard.container().size() == 0);
+    }
+    producer.join();
+    container.flush();
+    CHECK(container.size() == 100000);
+    CHECK(container.at(99999) == 99999);
+}
+
+TEST_CASE("A trickle of asynchronous adds is inserted in place") {
+    ConcurrentMagicalContainer container;
+    vector<int> elms(1000);
+    for (size_t i = 0; i < elms.size(); i++) {
+        elms[i] = (int)(2 * i);
+    }
+    container.addElements(std::span<const int>(elms));
+    // The merge leaves no spare capacity, so this insert reallocates once and leaves room for the trickle
+    container.addElement(-1);
+    const int* data = &container.read().container().at(0);
+    for (int elm : {7, 3001, 1}) {
+        container.addElementAsync(elm);
+        container.flush();
+    }
+    CHECK(&container.read().container().at(0) == data);
+    CHECK(container.size() == 1004);
+    CHECK(container.at(2) == 1);
+    CHECK(container.at(1003) == 3001);
+}
+
+TEST_CASE("Asynchronous adds") {
+    for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::BTree}) {
+        ConcurrentMagicalContainer container(layout);
+        container.flush();
+        CHECK(container.size() == 0);
+
+        // Four producers push more than the ring holds, so they also wait for the merger to make room
+        vector<thread> producers;
+        for (int p = 0; p < 4; ++p) {
+            producers.emplace_back([&container, p]() {
+                for (int i = 0; i < 40000; ++i) {
+                    container.addElementAsync(i * 4 + p);
+                }
+                container.flush();
+                // Everything this producer added is in now
+                CHECK(std::ranges::binary_search(container.read().ascending(), (40000 - 1) * 4 + p));
+            });
+        }
+        for (thread& producer : producers) {
+            producer.join();
+        }
+        CHECK(container.size() == 160000);
+        CHECK(container.at(0) == 0);
+        CHECK(container.at(159999) == 159999);
+        CHECK(container.p_value(0) == 2);
+
+        container.addElementAsync(-1);
+        container.addElementAsync(-1);
+        container.flush();
+        CHECK(container.at(0) == -1);
+        CHECK(container.removeElement(-1) == 1);
+        CHECK(container.size() == 160001);
+    }
+
+    // The merger empties the ring before the container goes away
+    ConcurrentMagicalContainer container;
+    for (int i = 0; i < 1000; ++i) {
+        container.addElementAsync(i);
+    }
+}
+
+TEST_CASE("Snapshot iteration") {
+    SUBCASE("A snapshot keeps its version") {
+        SnapshotMagicalContainer container;
+        vector<int> initial = {1, 2, 3, 4, 5, 6, 7};
+        container.addElements(std::span<const int>(initial));
+        {
+            SnapshotMagicalContainer::Snapshot before = container.snapshot();
+            container.addElement(11);
+            container.removeElement(2);
+            CHECK(container.update([](MagicalContainer& inner) { return inner.erase_if([](int elm) {
+                return elm % 2 == 0;
+            }); }) == 2);
+            CHECK_THROWS_AS(container.removeElement(2), runtime_error);
+            CHECK(std::ranges::equal(before.ascending(), initial));
+            CHECK(std::ranges::equal(before.primes(), vector<int>{2, 3, 5, 7}));
+            CHECK(std::ranges::equal(before.side_cross(), vector<int>{1, 7, 2, 6, 3, 5, 4}));
+            CHECK(std::ranges::equal(container.snapshot().ascending(), vector<int>{1, 3, 5, 7, 11}));
+            CHECK(container.pendingVersions() == 3);
+        }
+        // Nothing pins the old versions any more
+        CHECK(container.pendingVersions() == 0);
+        CHECK(container.size() == 5);
+        CHECK(container.p_size() == 4);
+    }
+
+    SUBCASE("A reader waits for a free slot asleep") {
+        SnapshotMagicalContainer container;
+        container.addElement(3);
+        vector<SnapshotMagicalContainer::Snapshot> held;
+        for (size_t i = 0; i < SnapshotMagicalContainer::MAX_READERS; ++i) {
+            held.push_back(container.snapshot());
+        }
+        atomic<int> seen(0);
+        thread reader([&container, &seen]() {
+            SnapshotMagicalContainer::Snapshot snapshot = container.snapshot();
+            seen.store(snapshot.container().at(0));
+        });
+        this_thread::sleep_for(chrono::milliseconds(10));
+        // Every slot is busy, so the reader sleeps: the process uses next to no CPU time meanwhile
+        std::clock_t cpu = std::clock();
+        this_thread::sleep_for(chrono::milliseconds(50));
+        CHECK(std::clock() - cpu < CLOCKS_PER_SEC / 100);
+        CHECK(seen.load() == 0);
+        held.pop_back();
+        reader.join();
+        CHECK(seen.load() == 3);
+        held.clear();
+        CHECK(container.pendingVersions() == 0);
+    }
+
+    SUBCASE("Readers don't block on a writer") {
+        for (StorageLayout layout : {StorageLayout::Vector, StorageLayout::Tiered, StorageLayout::Partitioned}) {
+            SnapshotMagicalContainer container(layout);
+            vector<int> initial;
+            for (int elm = 0; elm < 2000; elm += 2) {
+                initial.push_back(elm);
+            }
+            container.addElements(std::span<const int>(initial));
+            atomic<bool> done(false);
+            atomic<int> failures(0);
+            vector<thread> readers;
+            for (int r = 0; r < 4; ++r) {
+                readers.emplace_back([&container, &done, &failures]() {
+                    while (!done.load()) {
+                        SnapshotMagicalContainer::Snapshot snapshot = container.snapshot();
+                        auto ascending = snapshot.ascending();
+                        long sum = 0;
+                        snapshot.container().for_each<Order::Ascending>([&sum](int elm) { sum += elm; });
+                        long expected = 0;
+                        for (int elm : ascending) {
+                            expected += elm;
+                        }
+                        if (!std::ranges::is_sorted(ascending) || sum != expected ||
+                            snapshot.primes().size() != (size_type)snapshot.container().p_size() ||
+                            std::ranges::distance(snapshot.side_cross()) != snapshot.container().size()) {
+                            failures++;
+                        }
+                    }
+                });
+            }
+            for (int i = 0; i < 200; ++i) {
+                container.addElement(2001 + 2 * i);
+                container.tryRemoveElement(4 * i);
+            }
+            done.store(true);
+            for (thread& reader : readers) {
+                reader.join();
+            }
+            CHECK(failures.load() == 0);
+            CHECK(container.size() == 1000);
+            CHECK(container.pendingVersions() == 0);
+        }
+    }
+}
+
+TEST_CASE("Sharded container") {
+    SUBCASE("Same orders as one container, through splits and merges") {
+        ShardedMagicalContainer sharded(4, 64);
+        MagicalContainer expected;
+        unsigned int seed = 11;
+        vector<int> values;
+        for (int i = 0; i < 3000; ++i) {
+            seed = seed * 1103515245 + 12345;
+            // Skewed into a narrow range with duplicates, so the shards have to split
+            values.push_back((int)((seed >> 8) % 1500) - 100);
+        }
+        for (size_type i = 0; i < 1000; ++i) {
+            sharded.addElement(values[i]);
+            expected.addElement(values[i]);
+        }
+        std::span<const int> rest = std::span<const int>(values).subspan(1000);
+        sharded.addElements(rest);
+        expected.addElements(rest);
+        size_type peak = sharded.shardCount();
+        CHECK(peak > 4);
+        {
+            ShardedMagicalContainer::ReadGuard guard = sharded.read();
+            CHECK(guard.size() == expected.size());
+            CHECK(guard.p_size() == expected.p_size());
+            CHECK(std::ranges::equal(guard.ascending(), expected.ascending()));
+            CHECK(std::ranges::equal(guard.primes(), expected.primes()));
+            CHECK(std::ranges::equal(guard.side_cross(), expected.side_cross()));
+            for (size_type k = 0; k < (size_type)expected.p_size(); k += 7) {
+                REQUIRE(guard.p_value(k) == expected.p_value(k));
+            }
+            vector<int> visited;
+            guard.for_each<Order::SideCross>([&visited](int elm) { visited.push_back(elm); });
+            CHECK(std::ranges::equal(visited, expected.side_cross()));
+            CHECK_THROWS_AS(guard.at((size_type)guard.size()), out_of_range);
+        }
+
+        CHECK(sharded.removeElements(std::span<const int>(values).subspan(0, 2900)) ==
+              expected.removeElements(std::span<const int>(values).subspan(0, 2900)));
+        CHECK(sharded.tryRemoveElement(5000) == 0);
+        CHECK_THROWS_AS(sharded.removeElement(5000), runtime_error);
+        sharded.rebalance();
+        CHECK(sharded.balanced());
+        CHECK(sharded.shardCount() < peak);
+        CHECK(sharded.shardCount() >= 4);
+        CHECK(sharded.size() == expected.size());
+        ShardedMagicalContainer::ReadGuard guard = sharded.read();
+        CHECK(std::ranges::equal(guard.ascending(), expected.ascending()));
+        CHECK(std::ranges::equal(guard.primes(), expected.primes()));
+    }
+
+    SUBCASE("A sparse shard next to full ones") {
+        ShardedMagicalContainer sharded(1, 64);
+        vector<int> values;
+        for (int i = 0; i < 300; ++i) {
+            values.push_back(i);
+        }
+        // Two splits at the median: 0-74, 75-149, 150-224 and 225-299
+        sharded.addElements(values);
+        CHECK(sharded.shardCount() == 4);
+        vector<int> fill;
+        for (int i = 0; i < 52; ++i) {
+            fill.push_back(-1 - i);
+            fill.push_back(200);
+        }
+        sharded.addElements(fill);
+        sharded.removeElements(std::span<const int>(values).subspan(75, 73));
+        // 148 and 149 are left between two shards of 127, and merging them into either would need a split
+        CHECK(sharded.shardCount() == 4);
+        CHECK(sharded.balanced());
+
+        vector<int> negatives(fill.size() / 2);
+        std::ranges::copy(fill | std::views::filter([](int elm) { return elm < 0; }), negatives.begin());
+        sharded.removeElements(negatives);
+        CHECK(sharded.shardCount() == 3);
+        CHECK(sharded.balanced());
+        CHECK(sharded.size() == 300 - 73 + 52);
+        ShardedMagicalContainer::ReadGuard guard = sharded.read();
+        CHECK(std::ranges::is_sorted(guard.ascending()));
+        CHECK(guard.at(75) == 148);
+    }
+
+    SUBCASE("A batch spread thinly across the shards") {
+        ShardedMagicalContainer sharded(16);
+        vector<int> values;
+        vector<int> thin;
+        for (int64_t shard = 0; shard < 16; ++shard) {
+            int base = (int)((int64_t)INT_MIN + (shard << 28));
+            for (int i = 0; i < 1000; ++i) {
+                values.push_back(base + 2 * i);
+            }
+            thin.push_back(base + 3);
+        }
+        sharded.addElements(values);
+        // The merges leave no spare capacity, so these inserts reallocate once and leave room for the thin batch
+        for (int64_t shard = 0; shard < 16; ++shard) {
+            sharded.addElement((int)((int64_t)INT_MIN + (shard << 28)) + 1);
+        }
+        vector<const int*> firsts;
+        {
+            ShardedMagicalContainer::ReadGuard guard = sharded.read();
+            for (size_type shard = 0; shard < 16; ++shard) {
+                firsts.push_back(&guard.at(shard * 1001));
+            }
+        }
+        // One element per shard is inserted in place, not merged into a copy of every shard
+        sharded.addElements(thin);
+        CHECK(sharded.shardCount() == 16);
+        CHECK(sharded.size() == 16 * 1002);
+        {
+            ShardedMagicalContainer::ReadGuard guard = sharded.read();
+            for (size_type shard = 0; shard < 16; ++shard) {
+                CHECK(&guard.at(shard * 1002) == firsts[shard]);
+                CHECK(guard.at(shard * 1002 + 3) == thin[shard]);
+            }
+        }
+        CHECK(sharded.removeElements(thin) == 16);
+        CHECK(sharded.removeElements(thin) == 0);
+        CHECK(sharded.size() == 16 * 1001);
+    }
+
+    SUBCASE("A shard of one repeated value") {
+        ShardedMagicalContainer sharded(1, 16);
+        vector<int> sevens(100, 7);
+        sharded.addElements(sevens);
+        // Equal values stay in one shard, so this one can't be split
+        CHECK(sharded.shardCount() == 1);
+        CHECK(sharded.balanced());
+        sharded.addElement(8);
+        CHECK(sharded.shardCount() == 2);
+        CHECK(sharded.balanced());
+        sharded.rebalance();
+        CHECK(sharded.shardCount() == 2);
+        ShardedMagicalContainer::ReadGuard guard = sharded.read();
+        CHECK(guard.size() == 101);
+        CHECK(guard.at(100) == 8);
+    }
+
+    SUBCASE("Writers of different shards") {
+        ShardedMagicalContainer sharded(8, 256);
+        atomic<bool> done(false);
+        atomic<int> failures(0);
+        thread reader([&sharded, &done, &failures]() {
+            while (!done.load()) {
+                ShardedMagicalContainer::ReadGuard guard = sharded.read();
+                if (!std::ranges::is_sorted(guard.ascending()) ||
+                    std::ranges::distance(guard.primes()) != guard.p_size()) {
+                    failures++;
+                }
+            }
+        });
+        vector<thread> writers;
+        for (int w = 0; w < 4; ++w) {
+            writers.emplace_back([&sharded, w]() {
+                for (int i = 0; i < 1000; ++i) {
+                    sharded.addElement(w * 1000000 + i);
+                    if (i % 3 == 0) {
+                        sharded.removeElement(w * 1000000 + i / 2);
+                    }
+                }
+            });
+        }
+        for (thread& writer : writers) {
+            writer.join();
+        }
+        done.store(true);
+        reader.join();
+        CHECK(failures.load() == 0);
+        CHECK(sharded.size() == 4 * (1000 - 334));
+    }
+}
@@ -5,74 +5,155 @@
 using namespace ariel;
 
 typedef std::vector<int>::size_type size_type;
-typedef MagicalContainer::AscendingIterator AscendingIterator;
 
-AscendingIterator::AscendingIterator(MagicalContainer &container)
-: _container(container), current_index(0) {}
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::BasicAscendingIterator(): _container(nullptr), current_index(0) {}
 
-AscendingIterator::AscendingIterator(MagicalContainer &container, int index): _container(container){
-    if(index < 0 || index > container.size()){
-        throw std::out_of_range("AscendingIterator: iterator out of range");
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::BasicAscendingIterator(MagicalContainer &container)
+: _container(&container), current_index(0) {}
+
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::BasicAscendingIterator(const MagicalContainer& container, int index)
+: _container(&container) {
+    if constexpr (Checks::checks) {
+        if(index < 0 || index > container.size()){
+            throw std::out_of_range("AscendingIterator: iterator out of range");
+        }
     }
     current_index = index;
 }
 
-AscendingIterator::AscendingIterator(const AscendingIterator& other)
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::BasicAscendingIterator(const BasicAscendingIterator& other)
 : _container(other._container), current_index(other.current_index) {}
 
-AscendingIterator AscendingIterator::begin() {
-    return AscendingIterator(_container, 0);
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks> MagicalContainer::BasicAscendingIterator<Checks>::begin() {
+    return BasicAscendingIterator(*_container, 0);
 }
 
-AscendingIterator AscendingIterator::end() {
-    return AscendingIterator(_container, _container.size());
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks> MagicalContainer::BasicAscendingIterator<Checks>::end() {
+    return BasicAscendingIterator(*_container, _container->size());
 }
 
-int AscendingIterator::operator*() const {
-    return _container.at((size_type)current_index);
+template<typename Checks>
+bool MagicalContainer::BasicAscendingIterator<Checks>::operator<(const BasicAscendingIterator& other) const {
+    return current_index < other.current_index;
 }
 
-bool AscendingIterator::operator==(const AscendingIterator& other) const {
-    return current_index == other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicAscendingIterator<Checks>::operator>(const BasicAscendingIterator& other) const {
+    return current_index > other.current_index;
 }
 
-bool AscendingIterator::operator!=(const AscendingIterator& other) const {
-    return !(*this == other);
+template<typename Checks>
+bool MagicalContainer::BasicAscendingIterator<Checks>::operator<=(const BasicAscendingIterator& other) const {
+    return current_index <= other.current_index;
 }
 
-bool AscendingIterator::operator<(const AscendingIterator& other) const {
-    return current_index < other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicAscendingIterator<Checks>::operator>=(const BasicAscendingIterator& other) const {
+    return current_index >= other.current_index;
 }
 
-bool AscendingIterator::operator>(const AscendingIterator& other) const {
-    return (current_index > other.current_index) && (*this != other);
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks> MagicalContainer::BasicAscendingIterator<Checks>::operator++(int){
+    BasicAscendingIterator temp = BasicAscendingIterator(*this);
+    ++(*this);
+    return temp;
 }
 
-AscendingIterator& AscendingIterator::operator++(){
-    if(current_index >= _container.size()){
-        throw std::runtime_error("out of range");
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>& MagicalContainer::BasicAscendingIterator<Checks>::operator--(){
+    if constexpr (Checks::checks) {
+        if(current_index <= 0){
+            throw std::runtime_error("AscendingIterator: iterator out of range");
+        }
     }
-    current_index++;
+    current_index--;
     return *this;
 }
 
-const AscendingIterator AscendingIterator::operator++(int){
-    const AscendingIterator temp = AscendingIterator(*this);
-    current_index++;
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks> MagicalContainer::BasicAscendingIterator<Checks>::operator--(int){
+    BasicAscendingIterator temp = BasicAscendingIterator(*this);
+    --(*this);
     return temp;
 }
 
-AscendingIterator& AscendingIterator::operator=(const AscendingIterator& other) {
-    if(this->_container != other._container)
-        throw std::runtime_error("SideCrossIterator: iterators are not from the same container");
-    if (this != &other) {
-        _container = other._container;
-        current_index = other.current_index;
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>&
+MagicalContainer::BasicAscendingIterator<Checks>::operator+=(difference_type steps) {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target > _container->size()){
+            throw std::out_of_range("AscendingIterator: iterator out of range");
+        }
     }
+    current_index = (int)target;
     return *this;
 }
 
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>&
+MagicalContainer::BasicAscendingIterator<Checks>::operator-=(difference_type steps) {
+    return *this += -steps;
+}
+
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::operator+(difference_type steps) const {
+    BasicAscendingIterator moved(*this);
+    moved += steps;
+    return moved;
+}
+
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>
+MagicalContainer::BasicAscendingIterator<Checks>::operator-(difference_type steps) const {
+    BasicAscendingIterator moved(*this);
+    moved -= steps;
+    return moved;
+}
+
+template<typename Checks>
+std::ptrdiff_t MagicalContainer::BasicAscendingIterator<Checks>::operator-(const BasicAscendingIterator& other) const {
+    return current_index - other.current_index;
+}
 
+template<typename Checks>
+const int& MagicalContainer::BasicAscendingIterator<Checks>::operator[](difference_type steps) const {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target >= _container->size()){
+            throw std::out_of_range("AscendingIterator: iterator out of range");
+        }
+        return _container->at((size_type)target);
+    }
+    else {
+        return _container->atUnchecked((size_type)target);
+    }
+}
 
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>&
+MagicalContainer::BasicAscendingIterator<Checks>::operator=(const BasicAscendingIterator& other) {
+    if(_container != nullptr && _container != other._container)
+        throw std::runtime_error("AscendingIterator: iterators are not from the same container");
+    if (this != &other) {
+        _container = other._container;
+        current_index = other.current_index;
+    }
+    return *this;
+}
 
+template<typename Checks>
+MagicalContainer::BasicAscendingIterator<Checks>&
+MagicalContainer::BasicAscendingIterator<Checks>::operator=(BasicAscendingIterator&& other) {
+    return *this = other;
+}
 
+template class MagicalContainer::BasicAscendingIterator<Checked>;
+template class MagicalContainer::BasicAscendingIterator<Unchecked>;
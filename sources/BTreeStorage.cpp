@@ -0,0 +1,497 @@
+//
+// Created by super on 6/16/23.
+//
+
+#include "BTreeStorage.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+using namespace ariel;
+
+typedef BTreeStorage::Node Node;
+typedef BTreeStorage::Leaf Leaf;
+typedef BTreeStorage::Inner Inner;
+
+namespace {
+    const std::size_t LEAF_CAPACITY = 28;
+    const std::size_t INNER_CAPACITY = 16;
+
+    /**
+     * How full assign() packs the nodes, so the first inserts after a bulk load don't split everything
+     */
+    const std::size_t LEAF_FILL = 21;
+    const std::size_t INNER_FILL = 12;
+
+    /**
+     * @return uint32_t - a mask of the bits below pos
+     */
+    uint32_t bitsBelow(std::size_t pos) {
+        return (1U << pos) - 1;
+    }
+
+    /**
+     * @return std::size_t - the position of the k'th set bit of mask
+     */
+    std::size_t nthSetBit(uint32_t mask, std::size_t k) {
+        for (std::size_t i = 0; i < k; i++) {
+            mask &= mask - 1;
+        }
+        return (std::size_t)std::countr_zero(mask);
+    }
+}
+
+struct BTreeStorage::Node {
+    bool leaf;
+    explicit Node(bool is_leaf): leaf(is_leaf) {}
+};
+
+struct alignas(64) BTreeStorage::Leaf : BTreeStorage::Node {
+    uint32_t count;
+    uint32_t prime_mask; // bit i is set if keys[i] is prime
+    int keys[LEAF_CAPACITY];
+    Leaf(): Node(true), count(0), prime_mask(0), keys{} {}
+};
+
+struct BTreeStorage::Inner : BTreeStorage::Node {
+    std::size_t count;
+    Node* children[INNER_CAPACITY];
+    int low[INNER_CAPACITY];            // the smallest element in every child
+    std::size_t sizes[INNER_CAPACITY];  // the number of elements in every child
+    std::size_t primes[INNER_CAPACITY]; // the number of primes in every child
+    Inner(): Node(false), count(0), children{}, low{}, sizes{}, primes{} {}
+};
+
+namespace {
+    std::size_t subtreeSize(const Node* node) {
+        if (node->leaf) {
+            return static_cast<const Leaf*>(node)->count;
+        }
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < inner->count; i++) {
+            total += inner->sizes[i];
+        }
+        return total;
+    }
+
+    std::size_t subtreePrimes(const Node* node) {
+        if (node->leaf) {
+            return (std::size_t)std::popcount(static_cast<const Leaf*>(node)->prime_mask);
+        }
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < inner->count; i++) {
+            total += inner->primes[i];
+        }
+        return total;
+    }
+
+    int subtreeLow(const Node* node) {
+        if (node->leaf) {
+            return static_cast<const Leaf*>(node)->keys[0];
+        }
+        return static_cast<const Inner*>(node)->low[0];
+    }
+
+    /**
+     * @brief Recomputes the bookkeeping of the child in slot i from the child itself
+     */
+    void refresh(Inner* inner, std::size_t i) {
+        inner->low[i] = subtreeLow(inner->children[i]);
+        inner->sizes[i] = subtreeSize(inner->children[i]);
+        inner->primes[i] = subtreePrimes(inner->children[i]);
+    }
+
+    void moveSlot(Inner* to, std::size_t to_index, const Inner* from, std::size_t from_index) {
+        to->children[to_index] = from->children[from_index];
+        to->low[to_index] = from->low[from_index];
+        to->sizes[to_index] = from->sizes[from_index];
+        to->primes[to_index] = from->primes[from_index];
+    }
+
+    void insertSlot(Inner* inner, std::size_t pos, Node* child) {
+        for (std::size_t i = inner->count; i > pos; i--) {
+            moveSlot(inner, i, inner, i - 1);
+        }
+        inner->children[pos] = child;
+        inner->count++;
+        refresh(inner, pos);
+    }
+
+    void removeSlot(Inner* inner, std::size_t pos) {
+        for (std::size_t i = pos; i + 1 < inner->count; i++) {
+            moveSlot(inner, i, inner, i + 1);
+        }
+        inner->count--;
+    }
+
+    /**
+     * @return std::size_t - the slot of the last child whose smallest element is <= value, or count if there is none
+     */
+    std::size_t childFor(const Inner* inner, int value) {
+        std::size_t pos = (std::size_t)(std::upper_bound(inner->low, inner->low + inner->count, value) - inner->low);
+        return pos == 0 ? inner->count : pos - 1;
+    }
+
+    void destroy(Node* node) {
+        if (node->leaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        auto* inner = static_cast<Inner*>(node);
+        for (std::size_t i = 0; i < inner->count; i++) {
+            destroy(inner->children[i]);
+        }
+        delete inner;
+    }
+
+    Node* copy(const Node* node) {
+        if (node->leaf) {
+            return new Leaf(*static_cast<const Leaf*>(node));
+        }
+        auto* inner = new Inner(*static_cast<const Inner*>(node));
+        for (std::size_t i = 0; i < inner->count; i++) {
+            inner->children[i] = copy(inner->children[i]);
+        }
+        return inner;
+    }
+
+    void insertIntoLeaf(Leaf* leaf, int value, bool prime) {
+        auto pos = (std::size_t)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, value) - leaf->keys);
+        std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        leaf->keys[pos] = value;
+        uint32_t below = leaf->prime_mask & bitsBelow(pos);
+        uint32_t above = (leaf->prime_mask & ~bitsBelow(pos)) << 1U;
+        leaf->prime_mask = below | above | ((uint32_t)prime << pos);
+        leaf->count++;
+    }
+
+    /**
+     * @brief Inserts value into the subtree of node
+     * @return Node* - the new right sibling of node if node had to split, nullptr otherwise
+     */
+    Node* insertInto(Node* node, int value, bool prime) {
+        if (node->leaf) {
+            auto* leaf = static_cast<Leaf*>(node);
+            if (leaf->count < LEAF_CAPACITY) {
+                insertIntoLeaf(leaf, value, prime);
+                return nullptr;
+            }
+            auto* right = new Leaf();
+            std::size_t half = LEAF_CAPACITY / 2;
+            right->count = (uint32_t)(LEAF_CAPACITY - half);
+            std::copy(leaf->keys + half, leaf->keys + LEAF_CAPACITY, right->keys);
+            right->prime_mask = leaf->prime_mask >> half;
+            leaf->prime_mask &= bitsBelow(half);
+            leaf->count = (uint32_t)half;
+            insertIntoLeaf(value < right->keys[0] ? leaf : right, value, prime);
+            return right;
+        }
+
+        auto* inner = static_cast<Inner*>(node);
+        std::size_t pos = childFor(inner, value);
+        if (pos == inner->count) {
+            pos = 0;
+            inner->low[0] = value;
+        }
+        Node* split = insertInto(inner->children[pos], value, prime);
+        if (split == nullptr) {
+            inner->sizes[pos]++;
+            inner->primes[pos] += prime ? 1 : 0;
+            return nullptr;
+        }
+        refresh(inner, pos);
+        if (inner->count < INNER_CAPACITY) {
+            insertSlot(inner, pos + 1, split);
+            return nullptr;
+        }
+        auto* right = new Inner();
+        std::size_t half = INNER_CAPACITY / 2;
+        for (std::size_t i = half; i < INNER_CAPACITY; i++) {
+            moveSlot(right, i - half, inner, i);
+        }
+        right->count = INNER_CAPACITY - half;
+        inner->count = half;
+        if (pos + 1 <= half) {
+            insertSlot(inner, pos + 1, split);
+        }
+        else {
+            insertSlot(right, pos + 1 - half, split);
+        }
+        return right;
+    }
+
+    /**
+     * @brief Merges the child in slot i + 1 into the child in slot i if both fit in one node
+     */
+    void mergeChildren(Inner* inner, std::size_t i) {
+        Node* left = inner->children[i];
+        Node* right = inner->children[i + 1];
+        if (left->leaf) {
+            auto* left_leaf = static_cast<Leaf*>(left);
+            auto* right_leaf = static_cast<Leaf*>(right);
+            if (left_leaf->count + right_leaf->count > LEAF_CAPACITY) {
+                return;
+            }
+            std::copy(right_leaf->keys, right_leaf->keys + right_leaf->count, left_leaf->keys + left_leaf->count);
+            left_leaf->prime_mask |= right_leaf->prime_mask << left_leaf->count;
+            left_leaf->count += right_leaf->count;
+            delete right_leaf;
+        }
+        else {
+            auto* left_inner = static_cast<Inner*>(left);
+            auto* right_inner = static_cast<Inner*>(right);
+            if (left_inner->count + right_inner->count > INNER_CAPACITY) {
+                return;
+            }
+            for (std::size_t j = 0; j < right_inner->count; j++) {
+                moveSlot(left_inner, left_inner->count + j, right_inner, j);
+            }
+            left_inner->count += right_inner->count;
+            delete right_inner;
+        }
+        removeSlot(inner, i + 1);
+        refresh(inner, i);
+    }
+
+    bool underfull(const Node* node) {
+        if (node->leaf) {
+            return static_cast<const Leaf*>(node)->count < LEAF_CAPACITY / 4;
+        }
+        return static_cast<const Inner*>(node)->count < INNER_CAPACITY / 4;
+    }
+
+    /**
+     * @brief Erases one occurrence of value from the subtree of node
+     * @return int - 0 if value was not found, 1 if a non prime was erased, 2 if a prime was erased
+     */
+    int eraseFrom(Node* node, int value) {
+        if (node->leaf) {
+            auto* leaf = static_cast<Leaf*>(node);
+            auto pos = (std::size_t)(std::lower_bound(leaf->keys, leaf->keys + leaf->count, value) - leaf->keys);
+            if (pos == leaf->count || leaf->keys[pos] != value) {
+                return 0;
+            }
+            bool prime = ((leaf->prime_mask >> pos) & 1U) != 0;
+            std::copy(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+            leaf->prime_mask = (leaf->prime_mask & bitsBelow(pos)) | ((leaf->prime_mask >> 1U) & ~bitsBelow(pos));
+            leaf->count--;
+            return prime ? 2 : 1;
+        }
+
+        auto* inner = static_cast<Inner*>(node);
+        std::size_t pos = childFor(inner, value);
+        if (pos == inner->count) {
+            return 0;
+        }
+        int erased = eraseFrom(inner->children[pos], value);
+        if (erased == 0) {
+            return 0;
+        }
+        inner->sizes[pos]--;
+        inner->primes[pos] -= erased == 2 ? 1 : 0;
+        if (inner->sizes[pos] == 0) {
+            destroy(inner->children[pos]);
+            removeSlot(inner, pos);
+            return erased;
+        }
+        inner->low[pos] = subtreeLow(inner->children[pos]);
+        if (underfull(inner->children[pos])) {
+            if (pos + 1 < inner->count) {
+                mergeChildren(inner, pos);
+            }
+            else if (pos > 0) {
+                mergeChildren(inner, pos - 1);
+            }
+        }
+        return erased;
+    }
+
+    void exportFrom(const Node* node, std::vector<int>& values, PrimeBitmap& primes) {
+        if (node->leaf) {
+            const auto* leaf = static_cast<const Leaf*>(node);
+            for (std::size_t i = 0; i < leaf->count; i++) {
+                primes.push_back(((leaf->prime_mask >> i) & 1U) != 0);
+                values.push_back(leaf->keys[i]);
+            }
+            return;
+        }
+        const auto* inner = static_cast<const Inner*>(node);
+        for (std::size_t i = 0; i < inner->count; i++) {
+            exportFrom(inner->children[i], values, primes);
+        }
+    }
+
+    /**
+     * @return std::size_t - the number of groups of about fill items that total items are split into
+     */
+    std::size_t groupsOf(std::size_t total, std::size_t fill) {
+        return std::max<std::size_t>(1, (total + fill - 1) / fill);
+    }
+}
+
+BTreeStorage::BTreeStorage(): root(new Leaf()), element_count(0), prime_count(0) {}
+
+BTreeStorage::~BTreeStorage() {
+    destroy(root);
+}
+
+std::size_t BTreeStorage::size() const {
+    return element_count;
+}
+
+std::size_t BTreeStorage::primeCount() const {
+    return prime_count;
+}
+
+const int& BTreeStorage::at(std::size_t rank) const {
+    if (rank >= element_count) {
+        throw std::out_of_range("BTreeStorage: rank out of range");
+    }
+    const Node* node = root;
+    while (!node->leaf) {
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t i = 0;
+        while (rank >= inner->sizes[i]) {
+            rank -= inner->sizes[i];
+            i++;
+        }
+        node = inner->children[i];
+    }
+    return static_cast<const Leaf*>(node)->keys[rank];
+}
+
+std::span<const int> BTreeStorage::runAt(std::size_t rank) const {
+    if (rank >= element_count) {
+        throw std::out_of_range("BTreeStorage: rank out of range");
+    }
+    const Node* node = root;
+    while (!node->leaf) {
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t i = 0;
+        while (rank >= inner->sizes[i]) {
+            rank -= inner->sizes[i];
+            i++;
+        }
+        node = inner->children[i];
+    }
+    const auto* leaf = static_cast<const Leaf*>(node);
+    return std::span<const int>(leaf->keys + rank, leaf->count - rank);
+}
+
+std::size_t BTreeStorage::primeRank(std::size_t k) const {
+    if (k >= prime_count) {
+        throw std::out_of_range("BTreeStorage: prime index out of range");
+    }
+    std::size_t rank = 0;
+    const Node* node = root;
+    while (!node->leaf) {
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t i = 0;
+        while (k >= inner->primes[i]) {
+            k -= inner->primes[i];
+            rank += inner->sizes[i];
+            i++;
+        }
+        node = inner->children[i];
+    }
+    return rank + nthSetBit(static_cast<const Leaf*>(node)->prime_mask, k);
+}
+
+const int& BTreeStorage::primeValue(std::size_t k) const {
+    if (k >= prime_count) {
+        throw std::out_of_range("BTreeStorage: prime index out of range");
+    }
+    const Node* node = root;
+    while (!node->leaf) {
+        const auto* inner = static_cast<const Inner*>(node);
+        std::size_t i = 0;
+        while (k >= inner->primes[i]) {
+            k -= inner->primes[i];
+            i++;
+        }
+        node = inner->children[i];
+    }
+    const auto* leaf = static_cast<const Leaf*>(node);
+    return leaf->keys[nthSetBit(leaf->prime_mask, k)];
+}
+
+void BTreeStorage::insert(int value, bool prime) {
+    Node* split = insertInto(root, value, prime);
+    if (split != nullptr) {
+        auto* new_root = new Inner();
+        insertSlot(new_root, 0, root);
+        insertSlot(new_root, 1, split);
+        root = new_root;
+    }
+    element_count++;
+    prime_count += prime ? 1 : 0;
+}
+
+bool BTreeStorage::erase(int value) {
+    int erased = eraseFrom(root, value);
+    if (erased == 0) {
+        return false;
+    }
+    element_count--;
+    prime_count -= erased == 2 ? 1 : 0;
+    while (!root->leaf && static_cast<Inner*>(root)->count <= 1) {
+        auto* old_root = static_cast<Inner*>(root);
+        root = old_root->count == 1 ? old_root->children[0] : new Leaf();
+        delete old_root;
+    }
+    return true;
+}
+
+void BTreeStorage::exportTo(std::vector<int>& values, PrimeBitmap& primes) const {
+    values.clear();
+    primes.clear();
+    values.reserve(element_count);
+    primes.reserve(element_count);
+    exportFrom(root, values, primes);
+}
+
+void BTreeStorage::assign(const std::vector<int>& values, const PrimeBitmap& primes) {
+    destroy(root);
+    root = nullptr;
+    element_count = values.size();
+    prime_count = primes.count();
+
+    std::vector<Node*> level(groupsOf(values.size(), LEAF_FILL));
+    for (std::size_t j = 0; j < level.size(); j++) {
+        std::size_t begin = j * values.size() / level.size();
+        std::size_t end = (j + 1) * values.size() / level.size();
+        auto* leaf = new Leaf();
+        for (std::size_t i = begin; i < end; i++) {
+            if (primes.test(i)) {
+                leaf->prime_mask |= 1U << (i - begin);
+            }
+            leaf->keys[leaf->count++] = values[i];
+        }
+        level[j] = leaf;
+    }
+    while (level.size() > 1) {
+        std::vector<Node*> parents(groupsOf(level.size(), INNER_FILL));
+        for (std::size_t j = 0; j < parents.size(); j++) {
+            std::size_t begin = j * level.size() / parents.size();
+            std::size_t end = (j + 1) * level.size() / parents.size();
+            auto* inner = new Inner();
+            for (std::size_t i = begin; i < end; i++) {
+                insertSlot(inner, inner->count, level[i]);
+            }
+            parents[j] = inner;
+        }
+        level = std::move(parents);
+    }
+    root = level[0];
+}
+
+std::unique_ptr<OrderedStorage> BTreeStorage::clone() const {
+    auto other = std::make_unique<BTreeStorage>();
+    destroy(other->root);
+    other->root = copy(root);
+    other->element_count = element_count;
+    other->prime_count = prime_count;
+    return other;
+}
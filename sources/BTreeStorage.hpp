@@ -0,0 +1,94 @@
+//
+// Created by super on 6/16/23.
+//
+
+#ifndef MAGICAL_ITERATORS_BTREESTORAGE_H
+#define MAGICAL_ITERATORS_BTREESTORAGE_H
+#include "OrderedStorage.hpp"
+
+namespace ariel{
+    /**
+     * @brief BTreeStorage class - a B+tree with order statistics
+     * The leaves hold up to 28 sorted elements and a bit mask of which of them are prime, and fit in two cache lines.
+     * Every inner node keeps, for each child, the smallest element of the child's subtree (to route by value), the
+     * number of elements in it and the number of primes in it (to route by rank). Inserting, erasing, at() and
+     * primeRank() all walk one root to leaf path.
+     */
+    class BTreeStorage : public OrderedStorage {
+    public:
+        struct Node;
+        struct Leaf;
+        struct Inner;
+
+    private:
+        Node* root;
+        std::size_t element_count;
+        std::size_t prime_count;
+
+    public:
+        BTreeStorage();
+        ~BTreeStorage() override;
+        BTreeStorage(const BTreeStorage& other) = delete;
+        BTreeStorage& operator=(const BTreeStorage& other) = delete;
+        BTreeStorage(BTreeStorage&& other) = delete;
+        BTreeStorage& operator=(BTreeStorage&& other) = delete;
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t size() const override;
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t primeCount() const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        const int& at(std::size_t rank) const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        std::span<const int> runAt(std::size_t rank) const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        std::size_t primeRank(std::size_t k) const override;
+
+        /**
+         * @complexity O(log(n)), one walk instead of primeRank() and at()
+         */
+        const int& primeValue(std::size_t k) const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        void insert(int value, bool prime) override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        bool erase(int value) override;
+
+        /**
+         * @complexity O(n)
+         */
+        void exportTo(std::vector<int>& values, PrimeBitmap& primes) const override;
+
+        /**
+         * @brief Bulk loads the tree bottom up, leaving some room in every node for later inserts
+         * @complexity O(n)
+         */
+        void assign(const std::vector<int>& values, const PrimeBitmap& primes) override;
+
+        /**
+         * @complexity O(n)
+         */
+        std::unique_ptr<OrderedStorage> clone() const override;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_BTREESTORAGE_H
@@ -0,0 +1,65 @@
+//
+// Created by super on 6/22/23.
+//
+
+#include "MagicalContainer.hpp"
+#include <algorithm>
+using namespace ariel;
+
+typedef std::vector<int>::size_type size_type;
+typedef MagicalContainer::ChunkReader ChunkReader;
+
+ChunkReader::ChunkReader(const MagicalContainer& container, Order order, size_type max_len, std::span<int> buffer)
+: _container(&container), order(order), buffer(buffer), max_len(max_len), position(0) {
+    if(max_len == 0){
+        throw std::invalid_argument("ChunkReader: max_len must be positive");
+    }
+    bool zero_copy = order == Order::Ascending ||
+                     (order == Order::Prime && !container.storage && container.materialized_primes);
+    if(!zero_copy && buffer.empty()){
+        throw std::invalid_argument("ChunkReader: the prime and cross orders need a buffer");
+    }
+    bound = (size_type)(order == Order::Prime ? container.p_size() : container.size());
+}
+
+std::span<const int> ChunkReader::next() {
+    if(position >= bound){
+        return {};
+    }
+    size_type len = std::min(max_len, bound - position);
+    const MagicalContainer& container = *_container;
+    std::span<const int> block;
+    switch(order){
+        case Order::Ascending:
+            if(container.storage){
+                std::span<const int> run = container.storage->runAt(position);
+                block = run.first(std::min(len, run.size()));
+            }
+            else{
+                block = std::span<const int>(container.int_container.data() + position, len);
+            }
+            break;
+        case Order::Prime:
+            if(!container.storage && container.materialized_primes){
+                container.refreshPrimes();
+                block = std::span<const int>(container.prime_values.data() + position, len);
+                break;
+            }
+            len = std::min(len, buffer.size());
+            for (size_type i = 0; i < len; i++) {
+                buffer[i] = container.primeUnchecked(position + i);
+            }
+            block = buffer.first(len);
+            break;
+        case Order::SideCross:
+            len = std::min(len, buffer.size());
+            for (size_type i = 0; i < len; i++) {
+                size_type k = position + i;
+                buffer[i] = container.atUnchecked((k % 2 == 0) ? k / 2 : bound - 1 - k / 2);
+            }
+            block = buffer.first(len);
+            break;
+    }
+    position += block.size();
+    return block;
+}
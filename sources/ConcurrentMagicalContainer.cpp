@@ -0,0 +1,286 @@
+//
+// Created by super on 6/26/23.
+//
+
+#include "ConcurrentMagicalContainer.hpp"
+#include <bit>
+#include <functional>
+#include <thread>
+#include <vector>
+using namespace ariel;
+
+typedef std::vector<int>::size_type size_type;
+typedef ConcurrentMagicalContainer::ReadGuard ReadGuard;
+
+ReadGuard::ReadGuard(std::shared_lock<std::shared_mutex> lock, MagicalContainer& container)
+: lock(std::move(lock)), _container(&container) {}
+
+ConcurrentMagicalContainer::ConcurrentMagicalContainer(StorageLayout layout, PrimeTest prime_test)
+: container(layout, prime_test), requests(new Request[REQUEST_SLOTS]), published(0), combining(false),
+ingest(INGEST_CAPACITY), merged(0), merger_idle(false), stopping(false) {
+    for (size_type i = 0; i < REQUEST_SLOTS; i++) {
+        requests[i].state.store(FREE, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentMagicalContainer::~ConcurrentMagicalContainer() {
+    if(merger.joinable()){
+        stopping.store(true);
+        wakeMerger();
+        merger.join();
+    }
+}
+
+void ConcurrentMagicalContainer::wakeMerger() {
+    {
+        // Taking the mutex means the merger is either before its check of the ring or already waiting
+        std::lock_guard<std::mutex> lock(ingest_mutex);
+    }
+    ingest_ready.notify_one();
+}
+
+void ConcurrentMagicalContainer::mergeLoop() {
+    std::vector<int> batch;
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(ingest_mutex);
+            merger_idle.store(true);
+            // Pairs with the fence in addElementAsync: either the producer sees merger_idle, or this sees its push
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            ingest_ready.wait(lock, [this]() { return stopping.load() || ingest.readable(); });
+            merger_idle.store(false);
+        }
+        batch.clear();
+        ingest.drain(batch, MAX_INGEST_BATCH);
+        if(batch.empty()){
+            if(stopping.load()){
+                return;
+            }
+            continue;
+        }
+        {
+            // A trickle of adds drains in batches of a few elements, which addElements inserts one by one instead of
+            // merging a copy of the container (see MagicalContainer::smallBatch)
+            std::unique_lock<std::shared_mutex> lock = lockForWriting();
+            container.addElements(std::span<const int>(batch));
+        }
+        merged.store(ingest.consumed(), std::memory_order_release);
+        merged.notify_all();
+    }
+}
+
+void ConcurrentMagicalContainer::addElementAsync(int elm) {
+    std::call_once(merger_started, [this]() { merger = std::thread(&ConcurrentMagicalContainer::mergeLoop, this); });
+    while(!ingest.tryPush(elm)){
+        // The ring is full: sleep until the merger finishes a batch, which has freed the slots it drained
+        uint64_t seen = merged.load(std::memory_order_acquire);
+        if(ingest.tryPush(elm)){
+            break;
+        }
+        wakeMerger();
+        merged.wait(seen, std::memory_order_acquire);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(merger_idle.load()){
+        wakeMerger();
+    }
+}
+
+void ConcurrentMagicalContainer::flush() {
+    uint64_t target = ingest.reserved();
+    uint64_t done = merged.load(std::memory_order_acquire);
+    // The ring is drained in position order, so once the merged count reaches target every earlier push is in
+    while(done < target){
+        wakeMerger();
+        merged.wait(done, std::memory_order_acquire);
+        done = merged.load(std::memory_order_acquire);
+    }
+}
+
+std::unique_lock<std::shared_mutex> ConcurrentMagicalContainer::lockForWriting() const {
+    std::lock_guard<std::mutex> turn(turnstile);
+    return std::unique_lock<std::shared_mutex>(mutex);
+}
+
+std::shared_lock<std::shared_mutex> ConcurrentMagicalContainer::lockForReading() const {
+    while(true){
+        std::shared_lock<std::shared_mutex> reader(mutex, std::defer_lock);
+        {
+            std::lock_guard<std::mutex> turn(turnstile);
+            reader.lock();
+        }
+        if(container.readsPrepared()){
+            return reader;
+        }
+        reader.unlock();
+        // Another write may get in between the two locks, so the check runs again under the shared lock
+        std::unique_lock<std::shared_mutex> writer = lockForWriting();
+        container.prepareReads();
+    }
+}
+
+ReadGuard ConcurrentMagicalContainer::read() {
+    return ReadGuard(lockForReading(), container);
+}
+
+MagicalContainer ConcurrentMagicalContainer::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock = lockForReading();
+    return MagicalContainer(container);
+}
+
+void ConcurrentMagicalContainer::setLazyPrimeIndex(bool lazy) {
+    std::unique_lock<std::shared_mutex> lock = lockForWriting();
+    container.setLazyPrimeIndex(lazy);
+}
+
+void ConcurrentMagicalContainer::setMaterializedPrimes(bool materialize) {
+    std::unique_lock<std::shared_mutex> lock = lockForWriting();
+    container.setMaterializedPrimes(materialize);
+}
+
+int ConcurrentMagicalContainer::size() const {
+    std::shared_lock<std::shared_mutex> lock = lockForReading();
+    return container.size();
+}
+
+int ConcurrentMagicalContainer::p_size() const {
+    std::shared_lock<std::shared_mutex> lock = lockForReading();
+    return container.p_size();
+}
+
+int ConcurrentMagicalContainer::at(size_type elm) const {
+    std::shared_lock<std::shared_mutex> lock = lockForReading();
+    return container.at(elm);
+}
+
+int ConcurrentMagicalContainer::p_value(size_type elm) const {
+    std::shared_lock<std::shared_mutex> lock = lockForReading();
+    return container.p_value(elm);
+}
+
+int ConcurrentMagicalContainer::applyWrite(bool add, int value) {
+    if(add){
+        container.addElement(value);
+        return 1;
+    }
+    return container.tryRemoveElement(value);
+}
+
+int ConcurrentMagicalContainer::combine(bool add, int value) {
+    // A writer that finds no combiner becomes it, and writes without publishing a request
+    if(!combining.exchange(true)){
+        int result = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock = lockForWriting();
+            result = applyWrite(add, value);
+            applyRequests();
+        }
+        handOff();
+        return result;
+    }
+    size_type index = REQUEST_SLOTS;
+    size_type first = std::hash<std::thread::id>()(std::this_thread::get_id()) % REQUEST_SLOTS;
+    for (size_type i = 0; i < REQUEST_SLOTS && index == REQUEST_SLOTS; i++) {
+        int free = FREE;
+        if(requests[(first + i) % REQUEST_SLOTS].state.compare_exchange_strong(free, CLAIMED,
+                                                                               std::memory_order_acquire)){
+            index = (first + i) % REQUEST_SLOTS;
+        }
+    }
+    if(index == REQUEST_SLOTS){
+        // More writers than slots, this one takes the lock on its own
+        std::unique_lock<std::shared_mutex> lock = lockForWriting();
+        return applyWrite(add, value);
+    }
+    Request* request = &requests[index];
+    request->add = add;
+    request->value = value;
+    request->state.store(PENDING, std::memory_order_relaxed);
+    published.fetch_or((uint64_t)1 << index);
+    // The combiner may have left since the check above. If not, sleep until a combiner applies the request or hands
+    // this writer the role
+    bool combiner = !combining.exchange(true);
+    if(!combiner){
+        int state = PENDING;
+        while(state == PENDING){
+            request->state.wait(PENDING, std::memory_order_acquire);
+            state = request->state.load(std::memory_order_acquire);
+        }
+        if(state == PROMOTED){
+            request->state.store(PENDING, std::memory_order_relaxed);
+            combiner = true;
+        }
+    }
+    if(combiner){
+        {
+            std::unique_lock<std::shared_mutex> lock = lockForWriting();
+            applyRequests();
+        }
+        handOff();
+    }
+    int result = request->result;
+    request->state.store(FREE, std::memory_order_release);
+    return result;
+}
+
+void ConcurrentMagicalContainer::applyRequests() {
+    uint64_t pending = published.load();
+    if(pending == 0){
+        return;
+    }
+    // The combined writes all overlap in time, so any order is a valid one
+    for (uint64_t left = pending; left != 0; left &= left - 1) {
+        Request& request = requests[(size_type)std::countr_zero(left)];
+        request.result = applyWrite(request.add, request.value);
+    }
+    published.fetch_and(~pending);
+    for (uint64_t left = pending; left != 0; left &= left - 1) {
+        Request& request = requests[(size_type)std::countr_zero(left)];
+        request.state.store(DONE, std::memory_order_release);
+        request.state.notify_one();
+    }
+}
+
+void ConcurrentMagicalContainer::handOff() {
+    while(true){
+        uint64_t pending = published.load();
+        if(pending != 0){
+            // A writer that published during the pass is asleep, or about to be, and takes over
+            Request& request = requests[(size_type)std::countr_zero(pending)];
+            request.state.store(PROMOTED, std::memory_order_release);
+            request.state.notify_one();
+            return;
+        }
+        combining.store(false);
+        // A writer that published before the store may have found the role taken and gone to sleep, so the
+        // requests are checked once more after it; one that publishes after it finds the role free
+        if(published.load() == 0 || combining.exchange(true)){
+            return;
+        }
+    }
+}
+
+void ConcurrentMagicalContainer::addElement(int elm) {
+    combine(true, elm);
+}
+
+void ConcurrentMagicalContainer::addElements(std::span<const int> elms) {
+    std::unique_lock<std::shared_mutex> lock = lockForWriting();
+    container.addElements(elms);
+}
+
+int ConcurrentMagicalContainer::removeElement(int elm) {
+    if(combine(false, elm) == 0){
+        throw std::runtime_error("Element not found");
+    }
+    return 1;
+}
+
+int ConcurrentMagicalContainer::tryRemoveElement(int elm) {
+    return combine(false, elm);
+}
+
+int ConcurrentMagicalContainer::removeElements(std::span<const int> elms) {
+    std::unique_lock<std::shared_mutex> lock = lockForWriting();
+    return container.removeElements(elms);
+}
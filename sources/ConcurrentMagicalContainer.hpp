@@ -0,0 +1,307 @@
+//
+// Created by super on 6/26/23.
+//
+
+#ifndef MAGICAL_ITERATORS_CONCURRENTMAGICALCONTAINER_H
+#define MAGICAL_ITERATORS_CONCURRENTMAGICALCONTAINER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <thread>
+#include "IngestQueue.hpp"
+#include "MagicalContainer.hpp"
+
+namespace ariel{
+    /**
+     * @brief ConcurrentMagicalContainer class - a MagicalContainer that many threads can share
+     * A reader-writer lock guards the container: the writes take it exclusively, so they are serialized, and the
+     * reads and the traversals share it, so any number of AscendingIterator, PrimeIterator and SideCrossIterator
+     * walks run in parallel. The const methods of MagicalContainer update the lazy prime index and the prime
+     * bitmap's directory on demand, so before a reader shares the lock, a reader that finds them out of date brings
+     * them up to date under the exclusive lock (see MagicalContainer::prepareReads). A run of writes still pays for
+     * them once, on the first read after it.
+     * The iterators are safe while a ReadGuard holds the shared lock, and no longer than that. Prime walks on many
+     * threads share the prime bitmap's select hint and keep missing it, so for them turn on the materialized primes.
+     * std::shared_mutex doesn't promise that a writer ever gets in while readers keep coming (glibc prefers the
+     * readers), so both sides pass a turnstile mutex first: a waiting writer holds it until it has the lock, and the
+     * readers that come after it wait behind it.
+     * The single element writes are flat combined. A writer publishes its insert or remove in a request slot, and
+     * the one that finds no combiner becomes it: it takes the lock and applies every published request under that one
+     * hold, while the other writers sleep on their slot until it is done, so under contention the lock handoffs
+     * turn into batches and the waiting writers don't spin. The requests are applied one by one: a merge or a sweep
+     * costs a pass over the whole container, more than the up to REQUEST_SLOTS single writes it would replace.
+     * addElementAsync() doesn't wait at all: it pushes the element into a lock-free ring, and a merger thread
+     * (started by the first call) drains the ring in batches and adds each with addElements under the lock: a batch
+     * below the container's small-batch threshold is inserted element by element, a larger one is merged.
+     */
+    class ConcurrentMagicalContainer {
+        MagicalContainer container;
+        mutable std::shared_mutex mutex;
+        mutable std::mutex turnstile;
+
+        /**
+         * A published single element write. A slot goes FREE -> CLAIMED (by its writer) -> PENDING (ready for a
+         * combiner) -> DONE (applied, result set) -> FREE (its writer read the result), with a detour through
+         * PROMOTED (the combiner role was handed to its writer) back to PENDING. One cache line each
+         */
+        struct alignas(64) Request {
+            std::atomic<int> state;
+            bool add;
+            int value;
+            int result; // the number of elements added or removed
+        };
+
+        static const int FREE = 0;
+        static const int CLAIMED = 1;
+        static const int PENDING = 2;
+        static const int DONE = 3;
+        static const int PROMOTED = 4;
+        static const size_type REQUEST_SLOTS = 64;
+        std::unique_ptr<Request[]> requests;
+        std::atomic<uint64_t> published; // a bit for every PENDING or PROMOTED slot, so a pass skips the others
+        std::atomic<bool> combining;     // a writer holds the combiner role
+
+        /**
+         * The asynchronous inserts: the ring, the merger thread that drains it, and the number of positions merged
+         * so far, which flush() waits on. The merger sleeps on ingest_ready when the ring is empty, and merger_idle
+         * tells the producers that it needs a notification
+         */
+        static const size_type INGEST_CAPACITY = 1 << 16;
+        static const size_type MAX_INGEST_BATCH = 1 << 14;
+        IngestQueue ingest;
+        std::atomic<uint64_t> merged;
+        std::once_flag merger_started;
+        std::thread merger;
+        std::mutex ingest_mutex;
+        std::condition_variable ingest_ready;
+        std::atomic<bool> merger_idle;
+        std::atomic<bool> stopping;
+
+        /**
+         * @brief The merger thread: drains the ring into the container until the container is destroyed
+         */
+        void mergeLoop();
+
+        /**
+         * @brief Wakes the merger thread up if it sleeps
+         */
+        void wakeMerger();
+
+        /**
+         * @brief Applies one insert or remove. The caller holds the exclusive lock
+         * @return int - the number of elements added or removed
+         */
+        int applyWrite(bool add, int value);
+
+        /**
+         * @brief Writes directly if no other writer is the combiner, otherwise publishes the insert or remove and
+         * sleeps until it was applied, applying the published requests itself if the role is handed to it
+         * @return int - the number of elements added or removed
+         */
+        int combine(bool add, int value);
+
+        /**
+         * @brief Applies every pending request and wakes its writer. The caller holds the exclusive lock
+         */
+        void applyRequests();
+
+        /**
+         * @brief Gives up the combiner role: hands it to the writer of a request published during the pass, or
+         * clears it if there is none
+         */
+        void handOff();
+
+        /**
+         * @brief Takes the exclusive lock, holding the turnstile while it waits for the readers to leave
+         * @return std::unique_lock<std::shared_mutex> - the held exclusive lock
+         */
+        std::unique_lock<std::shared_mutex> lockForWriting() const;
+
+        /**
+         * @brief Takes the shared lock, after bringing the container's on demand indexes up to date under the
+         * exclusive lock if a write left them out of date
+         * @return std::shared_lock<std::shared_mutex> - the held shared lock
+         */
+        std::shared_lock<std::shared_mutex> lockForReading() const;
+
+    public:
+        /**
+         * @brief ReadGuard class - shared access to the container
+         * The guard holds the shared lock from read() until it is destroyed. The views and iterators it hands out
+         * are valid as long as the guard is, and the writes of other threads wait for it
+         */
+        class ReadGuard {
+            std::shared_lock<std::shared_mutex> lock;
+            MagicalContainer* _container;
+
+            ReadGuard(std::shared_lock<std::shared_mutex> lock, MagicalContainer& container);
+            friend class ConcurrentMagicalContainer;
+
+        public:
+            /**
+             * @return const MagicalContainer& - the container, for its const methods, for_each and chunks
+             */
+            const MagicalContainer& container() const {
+                return *_container;
+            }
+
+            /**
+             * @return MagicalContainer::AscendingView - the elements in ascending order
+             */
+            MagicalContainer::AscendingView ascending() const {
+                return _container->ascending();
+            }
+
+            /**
+             * @return MagicalContainer::PrimeView - the prime numbers in ascending order
+             */
+            MagicalContainer::PrimeView primes() const {
+                return _container->primes();
+            }
+
+            /**
+             * @return MagicalContainer::SideCrossView - the elements in cross order
+             */
+            MagicalContainer::SideCrossView side_cross() const {
+                return _container->side_cross();
+            }
+        };
+
+        /**
+         * @brief A constructor that picks the storage layout of the container
+         * @param layout The layout to keep the elements in
+         * @param prime_test The test used to decide which elements the PrimeIterator visits
+         * @throws invalid_argument if prime_test is null
+         */
+        explicit ConcurrentMagicalContainer(StorageLayout layout = StorageLayout::Vector,
+                                            PrimeTest prime_test = isPrime);
+
+        /**
+         * @brief Merges what is left in the ring and stops the merger thread
+         */
+        ~ConcurrentMagicalContainer();
+
+        /**
+         * The lock can't be copied or moved, so neither can the container
+         */
+        ConcurrentMagicalContainer(const ConcurrentMagicalContainer& other) = delete;
+        ConcurrentMagicalContainer& operator=(const ConcurrentMagicalContainer& other) = delete;
+        ConcurrentMagicalContainer(ConcurrentMagicalContainer&& other) = delete;
+        ConcurrentMagicalContainer& operator=(ConcurrentMagicalContainer&& other) = delete;
+
+        /**
+         * @brief Takes the shared lock for a run of reads or traversals
+         * @return ReadGuard - the guard, it must not outlive the container
+         * @complexity Blocks while a write is running, plus MagicalContainer::prepareReads after a write
+         */
+        ReadGuard read();
+
+        /**
+         * @brief Runs f on the container under the exclusive lock, for writes this class doesn't wrap
+         * @param f Called as f(MagicalContainer&)
+         * @return what f returns
+         */
+        template<typename F>
+        decltype(auto) write(F&& f) {
+            std::unique_lock<std::shared_mutex> lock = lockForWriting();
+            return f(container);
+        }
+
+        /**
+         * @brief Calls f on every element in the given order under the shared lock, see MagicalContainer::for_each
+         */
+        template<Order order, typename F>
+        void for_each(F&& f) const {
+            std::shared_lock<std::shared_mutex> lock = lockForReading();
+            container.for_each<order>(std::forward<F>(f));
+        }
+
+        /**
+         * @brief Copies the container under the shared lock
+         * @return MagicalContainer - a copy the caller can read without any lock
+         * @complexity O(n)
+         */
+        MagicalContainer snapshot() const;
+
+        /**
+         * @see MagicalContainer::setLazyPrimeIndex
+         */
+        void setLazyPrimeIndex(bool lazy);
+
+        /**
+         * @see MagicalContainer::setMaterializedPrimes
+         */
+        void setMaterializedPrimes(bool materialize);
+
+        /**
+         * @return int - the number of elements
+         */
+        int size() const;
+
+        /**
+         * @return int - the number of prime elements
+         */
+        int p_size() const;
+
+        /**
+         * @brief Returns the element of the given rank. It is returned by value, a reference into the container
+         * would outlive the lock
+         * @throws out_of_range if elm >= size()
+         */
+        int at(size_type elm) const;
+
+        /**
+         * @brief Returns the elm'th prime number, by value like at()
+         * @throws out_of_range if elm >= p_size()
+         */
+        int p_value(size_type elm) const;
+
+        /**
+         * @see MagicalContainer::addElement
+         * @complexity O(n), shared with the writes combined with it
+         */
+        void addElement(int elm);
+
+        /**
+         * @brief Queues an element to be added by the merger thread, and returns without waiting for it
+         * The element shows in reads once the merger gets to it, and surely after a flush(). A remove of it before
+         * then may not find it
+         * @param elm The element to add
+         * @complexity O(1) and lock-free, unless the ring is full: then it sleeps until the merger makes room
+         */
+        void addElementAsync(int elm);
+
+        /**
+         * @brief Waits until every addElementAsync() call that returned before this one was merged into the
+         * container, so reads see those elements
+         */
+        void flush();
+
+        /**
+         * @see MagicalContainer::addElements
+         */
+        void addElements(std::span<const int> elms);
+
+        /**
+         * @see MagicalContainer::removeElement
+         * @throws runtime_error if the element is not in the container
+         */
+        int removeElement(int elm);
+
+        /**
+         * @see MagicalContainer::tryRemoveElement
+         */
+        int tryRemoveElement(int elm);
+
+        /**
+         * @see MagicalContainer::removeElements
+         */
+        int removeElements(std::span<const int> elms);
+    };
+}
+
+#endif //MAGICAL_ITERATORS_CONCURRENTMAGICALCONTAINER_H
@@ -0,0 +1,61 @@
+//
+// Created by super on 6/30/23.
+//
+
+#include "IngestQueue.hpp"
+#include <bit>
+using namespace ariel;
+
+IngestQueue::IngestQueue(std::size_t capacity)
+: cells(new Cell[std::bit_ceil(capacity)]), mask(std::bit_ceil(capacity) - 1), tail(0), head(0) {
+    for (uint64_t i = 0; i <= mask; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool IngestQueue::tryPush(int value) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells[pos & mask];
+        uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence == pos) {
+            // The cell is free for this lap, reserve it if no other producer took the position first
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.value = value;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (sequence < pos) {
+            // The consumer hasn't read this cell's previous lap yet
+            return false;
+        }
+        else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+std::size_t IngestQueue::drain(std::vector<int>& out, std::size_t max) {
+    std::size_t moved = 0;
+    while (moved < max && readable()) {
+        Cell& cell = cells[head & mask];
+        out.push_back(cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        moved++;
+    }
+    return moved;
+}
+
+bool IngestQueue::readable() const {
+    return cells[head & mask].sequence.load(std::memory_order_acquire) == head + 1;
+}
+
+uint64_t IngestQueue::reserved() const {
+    return tail.load(std::memory_order_acquire);
+}
+
+uint64_t IngestQueue::consumed() const {
+    return head;
+}
@@ -0,0 +1,71 @@
+//
+// Created by super on 6/30/23.
+//
+
+#ifndef MAGICAL_ITERATORS_INGESTQUEUE_H
+#define MAGICAL_ITERATORS_INGESTQUEUE_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ariel{
+    /**
+     * @brief IngestQueue class - a bounded lock-free ring of ints with many producers and one consumer
+     * Every cell has a sequence number that says whose turn it is: a producer reserves a position with one
+     * compare-and-swap on the tail and publishes its value by bumping the cell's sequence, and the consumer reads
+     * the cells in position order, each once its sequence says it was published, and hands it back to the
+     * producers of the next lap. Producers never wait for each other or for the consumer, except when the ring is
+     * full and tryPush() fails.
+     */
+    class IngestQueue {
+        struct Cell {
+            std::atomic<uint64_t> sequence; // position when free, position + 1 when published
+            int value;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        uint64_t mask;
+        alignas(64) std::atomic<uint64_t> tail; // the next position to reserve
+        alignas(64) uint64_t head;              // the next position to read, only the consumer touches it
+
+    public:
+        /**
+         * @param capacity The number of cells, rounded up to a power of two
+         */
+        explicit IngestQueue(std::size_t capacity);
+
+        /**
+         * @brief Appends a value, from any thread
+         * @return bool - false if the ring is full
+         * @complexity O(1), lock-free
+         */
+        bool tryPush(int value);
+
+        /**
+         * @brief Moves up to max published values, in position order, to the end of out. Consumer only
+         * @return std::size_t - the number of values moved
+         * @complexity O(the number of values moved)
+         */
+        std::size_t drain(std::vector<int>& out, std::size_t max);
+
+        /**
+         * @return bool - true if the next position is published, so drain() moves at least one value. Consumer only
+         */
+        bool readable() const;
+
+        /**
+         * @return uint64_t - the number of positions reserved so far. Every push that returned before the call is
+         * among them
+         */
+        uint64_t reserved() const;
+
+        /**
+         * @return uint64_t - the number of positions drained so far. Consumer only
+         */
+        uint64_t consumed() const;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_INGESTQUEUE_H
@@ -5,88 +5,348 @@
 #include "MagicalContainer.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <bit>
+#include "BTreeStorage.hpp"
+#include "PartitionedStorage.hpp"
+#include "TieredStorage.hpp"
 using namespace std;
 using namespace ariel;
 
 typedef std::vector<int>::size_type size_type;
 
-MagicalContainer::MagicalContainer(): int_container(0), prime_indexes(0) {}
+MagicalContainer::MagicalContainer()
+: int_container(0), lazy_primes(false), primes_valid(0), materialized_primes(false), prime_test(isPrime) {}
+
+MagicalContainer::MagicalContainer(PrimeTest prime_test)
+: int_container(0), lazy_primes(false), primes_valid(0), materialized_primes(false), prime_test(prime_test) {
+    if(prime_test == nullptr){
+        throw invalid_argument("MagicalContainer: prime test must not be null");
+    }
+}
+
+MagicalContainer::MagicalContainer(StorageLayout layout, PrimeTest prime_test): MagicalContainer(prime_test) {
+    switch(layout){
+        case StorageLayout::Vector:
+            break;
+        case StorageLayout::BTree:
+            storage = make_unique<BTreeStorage>();
+            break;
+        case StorageLayout::Tiered:
+            storage = make_unique<TieredStorage>();
+            break;
+        case StorageLayout::Partitioned:
+            storage = make_unique<PartitionedStorage>();
+            break;
+    }
+}
 
 MagicalContainer::MagicalContainer(const MagicalContainer &other)
-: int_container(other.int_container), prime_indexes(other.prime_indexes) {}
+: int_container(other.int_container), prime_bitmap(other.prime_bitmap), lazy_primes(other.lazy_primes),
+primes_valid(other.primes_valid), materialized_primes(other.materialized_primes), prime_values(other.prime_values),
+prime_test(other.prime_test), storage(other.storage ? other.storage->clone() : nullptr) {}
+
+void MagicalContainer::setLazyPrimeIndex(bool lazy) {
+    if(storage){
+        throw invalid_argument("MagicalContainer: the lazy prime index needs the vector layout");
+    }
+    if(lazy && !lazy_primes){
+        primes_valid = int_container.size();
+    }
+    if(!lazy){
+        refreshPrimes();
+    }
+    lazy_primes = lazy;
+}
+
+bool MagicalContainer::lazyPrimeIndex() const {
+    return lazy_primes;
+}
+
+void MagicalContainer::refreshPrimes() const {
+    if(!lazy_primes || primes_valid == int_container.size()){
+        return;
+    }
+    // The bits before primes_valid are still right, the ones after it belong to elements that moved or are gone
+    prime_bitmap.truncate(primes_valid);
+    prime_bitmap.reserve(int_container.size());
+    if(materialized_primes){
+        prime_values.resize(prime_bitmap.count());
+    }
+    for (size_type i = primes_valid; i < int_container.size(); i++) {
+        bool prime = prime_test(int_container[i]);
+        prime_bitmap.push_back(prime);
+        if(prime && materialized_primes){
+            prime_values.push_back(int_container[i]);
+        }
+    }
+    primes_valid = int_container.size();
+}
+
+void MagicalContainer::rebuildPrimeValues() const {
+    prime_values.clear();
+    prime_values.reserve(prime_bitmap.count());
+    const vector<uint64_t>& words = prime_bitmap.data();
+    for (size_type w = 0; w < words.size(); w++) {
+        for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+            prime_values.push_back(int_container[w * 64 + (size_type)countr_zero(bits)]);
+        }
+    }
+}
+
+void MagicalContainer::setMaterializedPrimes(bool materialize) {
+    if(storage){
+        throw invalid_argument("MagicalContainer: materialized primes need the vector layout");
+    }
+    materialized_primes = materialize;
+    if(materialize){
+        refreshPrimes();
+        rebuildPrimeValues();
+    }
+    else{
+        vector<int>().swap(prime_values);
+    }
+}
+
+bool MagicalContainer::materializedPrimes() const {
+    return materialized_primes;
+}
+
+void MagicalContainer::prepareReads() const {
+    if(storage){
+        return;
+    }
+    refreshPrimes();
+    prime_bitmap.refreshDirectory();
+}
+
+bool MagicalContainer::readsPrepared() const {
+    if(storage){
+        return true;
+    }
+    return (!lazy_primes || primes_valid == int_container.size()) && prime_bitmap.directoryUpToDate();
+}
+
+size_type MagicalContainer::primeIndexMemory() const {
+    if(storage){
+        return 0;
+    }
+    return prime_bitmap.memoryUsage() + prime_values.capacity() * sizeof(int);
+}
 
 int MagicalContainer::size() const {
+    if(storage){
+        return (int)storage->size();
+    }
     return int_container.size();
 }
 
 int MagicalContainer::p_size() const {
-    return prime_indexes.size();
+    if(storage){
+        return (int)storage->primeCount();
+    }
+    refreshPrimes();
+    return (int)prime_bitmap.count();
 }
 
-int MagicalContainer::at(size_type elm) const {
+const int& MagicalContainer::at(size_type elm) const {
+    if(storage){
+        return storage->at(elm);
+    }
     return int_container.at(elm);
 }
 
 int MagicalContainer::p_at(size_type elm) const {
-    return prime_indexes.at(elm);
+    if(storage){
+        return (int)storage->primeRank(elm);
+    }
+    refreshPrimes();
+    return (int)prime_bitmap.select(elm);
 }
 
-bool isPrime(int num){
-    if (num < 2){
-        return false;
+const int& MagicalContainer::p_value(size_type elm) const {
+    if(storage){
+        return storage->primeValue(elm);
     }
-    for (int i = 2; i <= sqrt(num); i++) {
-        if (num % i == 0){
-            return false;
-        }
+    refreshPrimes();
+    if(materialized_primes){
+        return prime_values.at(elm);
     }
-    return true;
+    return int_container[prime_bitmap.select(elm)];
+}
+
+void MagicalContainer::unpackStorage() {
+    storage->exportTo(int_container, prime_bitmap);
+}
+
+void MagicalContainer::repackStorage() {
+    storage->assign(int_container, prime_bitmap);
+    vector<int>().swap(int_container);
+    prime_bitmap = PrimeBitmap();
 }
 
 void MagicalContainer::addElement(int elm) {
+    if(storage){
+        storage->insert(elm, prime_test(elm));
+        return;
+    }
     auto it = lower_bound(int_container.begin(), int_container.end(), elm);
+    auto pos = (size_type)(it - int_container.begin());
     int_container.insert(it, elm);
-    int counter = 0;
-    prime_indexes.clear();
-    for(auto element : int_container){
-        if(isPrime(element)){
-            prime_indexes.push_back(counter);
+    if(lazy_primes){
+        primes_valid = min(primes_valid, pos);
+        return;
+    }
+    bool prime = prime_test(elm);
+    prime_bitmap.insert(pos, prime);
+    if(prime && materialized_primes){
+        prime_values.insert(lower_bound(prime_values.begin(), prime_values.end(), elm), elm);
+    }
+}
+
+void MagicalContainer::addElements(std::span<const int> elms) {
+    mergeBatch(vector<int>(elms.begin(), elms.end()));
+}
+
+bool MagicalContainer::smallBatch(size_type count) const {
+    if(storage){
+        return count * SMALL_BATCH_RATIO < storage->size();
+    }
+    return count < (lazy_primes ? SMALL_LAZY_BATCH : SMALL_BATCH);
+}
+
+void MagicalContainer::mergeBatch(vector<int> batch) {
+    if(batch.empty()){
+        return;
+    }
+    // A small batch is cheaper to insert one by one than to merge through the vector layout
+    if(smallBatch(batch.size())){
+        for(int elm : batch){
+            addElement(elm);
+        }
+        return;
+    }
+    if(storage){
+        unpackStorage();
+    }
+    sort(batch.begin(), batch.end());
+    if(lazy_primes){
+        // Everything before the smallest new element keeps its position, and so its prime bit
+        auto first_new = (size_type)(lower_bound(int_container.begin(), int_container.end(), batch.front())
+                                     - int_container.begin());
+        vector<int> merged(int_container.size() + batch.size());
+        merge(int_container.begin(), int_container.end(), batch.begin(), batch.end(), merged.begin());
+        int_container = std::move(merged);
+        primes_valid = min(primes_valid, first_new);
+        return;
+    }
+    vector<int> merged;
+    PrimeBitmap merged_primes;
+    merged.reserve(int_container.size() + batch.size());
+    merged_primes.reserve(int_container.size() + batch.size());
+
+    size_type old_index = 0;
+    size_type batch_index = 0;
+    while(old_index < int_container.size() || batch_index < batch.size()){
+        if(batch_index == batch.size() ||
+           (old_index < int_container.size() && int_container[old_index] < batch[batch_index])){
+            merged_primes.push_back(prime_bitmap.test(old_index));
+            merged.push_back(int_container[old_index++]);
+        }
+        else{
+            merged_primes.push_back(prime_test(batch[batch_index]));
+            merged.push_back(batch[batch_index++]);
         }
-        counter++;
+    }
+    int_container = std::move(merged);
+    prime_bitmap = std::move(merged_primes);
+    if(materialized_primes){
+        rebuildPrimeValues();
+    }
+    if(storage){
+        repackStorage();
     }
 }
 
-int MagicalContainer::removeElement(int elm) {
+int MagicalContainer::tryRemoveElement(int elm) {
+    if(storage){
+        return storage->erase(elm) ? 1 : 0;
+    }
     auto it = lower_bound(int_container.begin(), int_container.end(), elm);
-    if(it == int_container.end()){
+    if(it == int_container.end() || *it != elm){
+        return 0;
+    }
+    auto pos = (size_type)(it - int_container.begin());
+    if(lazy_primes){
+        primes_valid = min(primes_valid, pos);
+    }
+    else if(prime_bitmap.erase(pos) && materialized_primes){
+        prime_values.erase(lower_bound(prime_values.begin(), prime_values.end(), elm));
+    }
+    int_container.erase(it);
+    return 1;
+}
+
+int MagicalContainer::removeElement(int elm) {
+    if(tryRemoveElement(elm) == 0){
         throw runtime_error("Element not found");
     }
-    if(isPrime(elm)){
-        int counter = 0;
-        for(auto element : int_container){
-            if(element != elm) counter++;
-            else break;
+    return 1;
+}
+
+int MagicalContainer::removeElements(std::span<const int> elms) {
+    // A small batch is cheaper to remove one by one than with a sweep over the whole container
+    if(smallBatch(elms.size())){
+        int removed = 0;
+        for(int elm : elms){
+            removed += tryRemoveElement(elm);
         }
-        auto it_prime = lower_bound(prime_indexes.begin(), prime_indexes.end(), counter);
-        prime_indexes.erase(it_prime);
+        return removed;
     }
-    if(*it == elm){
-        int_container.erase(it);
-        return 1;
-    }
-    return 0;
+    vector<int> batch(elms.begin(), elms.end());
+    sort(batch.begin(), batch.end());
+    size_type next = 0;
+    // erase_if visits the elements in ascending order, so the sorted batch is consumed alongside them
+    return erase_if([&batch, &next](int elm) {
+        while(next < batch.size() && batch[next] < elm){
+            next++;
+        }
+        if(next < batch.size() && batch[next] == elm){
+            next++;
+            return true;
+        }
+        return false;
+    });
 }
 
 void MagicalContainer::print() {
     cout << "int_container: ";
-    for (auto element : int_container) {
-        cout << element << " ";
+    for (int i = 0; i < size(); i++) {
+        cout << at((size_type)i) << " ";
     }
     cout << endl;
 }
 
 bool MagicalContainer::operator==(const MagicalContainer& other) const {
-    return (int_container == other.int_container) && (prime_indexes == other.prime_indexes);
+    if(!storage && !other.storage){
+        refreshPrimes();
+        other.refreshPrimes();
+        return (int_container == other.int_container) && (prime_bitmap == other.prime_bitmap);
+    }
+    if(size() != other.size() || p_size() != other.p_size()){
+        return false;
+    }
+    for (size_type i = 0; i < (size_type)size(); i++) {
+        if(at(i) != other.at(i)){
+            return false;
+        }
+    }
+    for (size_type i = 0; i < (size_type)p_size(); i++) {
+        if(p_at(i) != other.p_at(i)){
+            return false;
+        }
+    }
+    return true;
 }
 
 bool MagicalContainer::operator!=(const MagicalContainer& other) const {
@@ -96,7 +356,13 @@ bool MagicalContainer::operator!=(const MagicalContainer& other) const {
 MagicalContainer& MagicalContainer::operator=(const MagicalContainer& other) {
     if (this != &other) {
         int_container = other.int_container;
-        prime_indexes = other.prime_indexes;
+        prime_bitmap = other.prime_bitmap;
+        lazy_primes = other.lazy_primes;
+        primes_valid = other.primes_valid;
+        materialized_primes = other.materialized_primes;
+        prime_values = other.prime_values;
+        prime_test = other.prime_test;
+        storage = other.storage ? other.storage->clone() : nullptr;
     }
     return *this;
 }
\ No newline at end of file
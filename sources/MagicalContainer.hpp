@@ -6,7 +6,16 @@
 #define MAGICAL_ITERATORS_MAGICALCONTAINER_H
 #include <vector>
 #include <iostream>
+#include <bit>
 #include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include "OrderedStorage.hpp"
+#include "PrimeBitmap.hpp"
+#include "Primality.hpp"
 using namespace std;
 
 /**
@@ -15,22 +24,184 @@ using namespace std;
 typedef std::vector<int>::size_type size_type;
 
 namespace ariel{
+    /**
+     * The layouts a MagicalContainer can keep its elements in:
+     * Vector - a sorted vector and the indexes of its primes. Fastest to iterate, O(n) inserts and removes
+     * BTree - a B+tree with order statistics (see BTreeStorage). O(log(n)) inserts, removes and iterator steps
+     * Tiered - sorted blocks and a small directory (see TieredStorage). O(sqrt(n)) inserts and removes, mostly
+     * contiguous iteration. A middle ground for containers of 10^4 to 10^6 elements
+     * Partitioned - the primes and the other elements in two sorted vectors (see PartitionedStorage). Prime
+     * traversals stream one array, ascending and cross order pay a binary search per step
+     */
+    enum class StorageLayout { Vector, BTree, Tiered, Partitioned };
+
+    /**
+     * The orders a MagicalContainer can be walked in, the same as its three iterators:
+     * Ascending - all the elements in ascending order
+     * Prime - the prime elements in ascending order
+     * SideCross - all the elements in the order [first, last, second, second last, ...]
+     */
+    enum class Order { Ascending, Prime, SideCross };
+
+    /**
+     * The iterator checking policies, the template parameter of the three iterators. With Checked, the policy of
+     * AscendingIterator, PrimeIterator and SideCrossIterator, the position constructor, *, [], ++, --, += and -=
+     * check the iterator's bounds and throw when it leaves the container. With Unchecked (UncheckedAscendingIterator,
+     * UncheckedPrimeIterator and UncheckedSideCrossIterator) none of them do, so a traversal or random access loop over
+     * the vector layout is index arithmetic and a load, and leaving the container is undefined like with the standard
+     * containers. The policy is part of the iterator's type, so both kinds of iterators can be used in one program
+     */
+    struct Checked {
+        static constexpr bool checks = true;
+    };
+
+    struct Unchecked {
+        static constexpr bool checks = false;
+    };
+
     class MagicalContainer {
         /**
          * The container is implemented as a vector of integers
-         * The prime_indexes vector is used to store the indexes of the prime numbers in the container. This improves
-         * the concept of saving pointers to the prime numbers in the container, because the indexes size is much smaller
-         * than the size of a pointer.
+         * The prime_bitmap has one bit per element of int_container, set for the prime numbers, and a rank/select
+         * directory on top of it. p_at(k) is a select on the bitmap and p_size() is its population count, and an insert
+         * or a remove shifts bits instead of patching a vector of indexes
          */
         vector<int> int_container;
-        vector<int> prime_indexes;
+        mutable PrimeBitmap prime_bitmap;
+
+        /**
+         * The lazy prime index (vector layout only). When lazy_primes is set, writes don't touch prime_bitmap, they
+         * only lower primes_valid - the number of leading elements whose prime bits are up to date. The first
+         * p_size(), p_at() or PrimeIterator after them retests the elements from primes_valid on (see refreshPrimes)
+         */
+        bool lazy_primes;
+        mutable size_type primes_valid;
+
+        /**
+         * The materialized primes (vector layout only). When materialized_primes is set, prime_values keeps a sorted
+         * copy of the prime elements, updated on every write (or with the dirty range of the lazy prime index), so a
+         * prime traversal reads one array front to back instead of a select and a load from int_container per prime
+         */
+        bool materialized_primes;
+        mutable vector<int> prime_values;
+
+        /**
+         * The primality test used to classify the elements, isPrime unless another engine was plugged in
+         */
+        PrimeTest prime_test;
+
+        /**
+         * The alternative storage layout, nullptr for the default vector layout.
+         * When it is set int_container and prime_bitmap are empty, except for batch operations that use them as
+         * scratch space (see unpackStorage)
+         */
+        unique_ptr<OrderedStorage> storage;
+
+        /**
+         * A batch smaller than 1/SMALL_BATCH_RATIO of a storage is inserted element by element instead of merged
+         */
+        static const size_type SMALL_BATCH_RATIO = 16;
+
+        /**
+         * A batch of fewer than SMALL_BATCH elements is inserted into the vector layout element by element instead
+         * of merged (SMALL_LAZY_BATCH with the lazy prime index). Both cost O(n) per element or per merge, and with
+         * -O2 one merge measured as 70 to 130 single inserts at n = 1e4 to 1e6, or about 20 with the lazy prime
+         * index, where the merge doesn't test or carry prime bits. The thresholds sit well below that break-even
+         */
+        static const size_type SMALL_BATCH = 32;
+        static const size_type SMALL_LAZY_BATCH = 8;
+
+        /**
+         * @brief Decides whether a batch is cheaper to apply element by element than in one linear pass
+         * @param count The number of elements in the batch
+         * @return bool - true below SMALL_BATCH (or SMALL_LAZY_BATCH) elements with the vector layout, below
+         * 1/SMALL_BATCH_RATIO of the storage otherwise
+         * @complexity O(1)
+         */
+        bool smallBatch(size_type count) const;
+
+        /**
+         * @brief Copies the elements of the storage into int_container and prime_bitmap, so the vector layout's
+         * batch algorithms can run on them
+         * @complexity O(n)
+         */
+        void unpackStorage();
+
+        /**
+         * @brief Loads int_container and prime_bitmap back into the storage and empties them
+         * @complexity O(n)
+         */
+        void repackStorage();
+
+        /**
+         * @brief Brings prime_bitmap up to date with int_container when the lazy prime index has a dirty range
+         * @complexity O(the number of elements from primes_valid on), O(1) when nothing is dirty
+         */
+        void refreshPrimes() const;
+
+        /**
+         * @brief Refills prime_values from int_container and prime_bitmap
+         * @complexity O(n)
+         */
+        void rebuildPrimeValues() const;
+
+        /**
+         * @brief Merges a batch of new elements into the container
+         * The batch is sorted, merged with int_container in one linear pass, and only the new elements are tested
+         * for primality. The prime bits of the old elements are carried over while merging. A small batch (see
+         * smallBatch) is inserted with addElement instead
+         * @param batch The elements to add, in any order
+         * @complexity O(n + k*log(k)) for n elements in the container and k in the batch, O(k*n) below SMALL_BATCH
+         */
+        void mergeBatch(vector<int> batch);
+
+        /**
+         * @brief p_value() without the bounds checks, for the unchecked iterators
+         */
+        const int& primeUnchecked(size_type k) const {
+            if(storage){
+                return storage->primeValue(k);
+            }
+            if(lazy_primes && primes_valid != int_container.size()){
+                refreshPrimes();
+            }
+            if(materialized_primes){
+                return prime_values[k];
+            }
+            return int_container[prime_bitmap.select(k)];
+        }
+
+        /**
+         * @brief at() without the bounds check of the vector layout, for the unchecked iterators
+         */
+        const int& atUnchecked(size_type elm) const {
+            if(storage){
+                return storage->at(elm);
+            }
+            return int_container[elm];
+        }
     public:
         /**
          * The default constructor
-         * Initializes the container and the prime_indexes vectors to be empty
+         * Initializes the container and the prime_bitmap to be empty
          */
         MagicalContainer();
 
+        /**
+         * @brief A constructor that plugs in a different primality engine
+         * @param prime_test The test used to decide which elements the PrimeIterator visits
+         * @throws invalid_argument if prime_test is null
+         */
+        explicit MagicalContainer(PrimeTest prime_test);
+
+        /**
+         * @brief A constructor that picks the storage layout of the container
+         * @param layout The layout to keep the elements in
+         * @param prime_test The test used to decide which elements the PrimeIterator visits
+         * @throws invalid_argument if prime_test is null
+         */
+        explicit MagicalContainer(StorageLayout layout, PrimeTest prime_test = isPrime);
+
         /**
          * The copy constructor
          * @param other The MagicalContainer to copy
@@ -44,6 +215,60 @@ namespace ariel{
         MagicalContainer(MagicalContainer &&other) = delete;
         MagicalContainer &operator=(MagicalContainer &&other) = delete;
 
+        /**
+         * @brief Turns the lazy prime index on or off
+         * In lazy mode addElement, the batch operations and the removes never test primality or shift prime bits,
+         * they only record where the dirty range of the prime index starts. The dirty range is rebuilt the first time
+         * p_size(), p_at() or a PrimeIterator needs it, so a container that is never iterated by primes pays nothing
+         * for them. Turning it off brings the prime index up to date right away
+         * @param lazy true to defer the prime index, false to keep it up to date on every write
+         * @throws invalid_argument if the container doesn't use the vector layout
+         */
+        void setLazyPrimeIndex(bool lazy);
+
+        /**
+         * @return true if the prime index is rebuilt on demand
+         */
+        bool lazyPrimeIndex() const;
+
+        /**
+         * @brief Turns the materialized primes on or off
+         * With materialized primes the container keeps a sorted copy of its prime elements next to int_container.
+         * Every write that adds or removes a prime patches the copy (O(p) for p primes), and in return the
+         * PrimeIterator, p_value(), for_each<Order::Prime> and chunks(Order::Prime) read the primes as one contiguous
+         * stream. The copy costs sizeof(int) bytes per prime, see primeIndexMemory()
+         * @param materialize true to keep the copy, false to drop it
+         * @throws invalid_argument if the container doesn't use the vector layout
+         */
+        void setMaterializedPrimes(bool materialize);
+
+        /**
+         * @return true if the container keeps a copy of its prime elements
+         */
+        bool materializedPrimes() const;
+
+        /**
+         * @brief Brings every index that the const methods otherwise update on demand up to date: the dirty range of
+         * the lazy prime index and the rank/select directory of the prime bitmap. Until the next write the const
+         * methods and the iterators then read the container without writing to it (the lookup hints they keep are
+         * relaxed atomics), so any number of threads can walk it at once. See ConcurrentMagicalContainer
+         * @complexity O(the dirty range of the lazy prime index + n / 64), O(1) when readsPrepared()
+         */
+        void prepareReads() const;
+
+        /**
+         * @return true if prepareReads() has nothing to do
+         */
+        bool readsPrepared() const;
+
+        /**
+         * @brief Returns the memory the prime index takes: the prime bitmap, and the materialized primes when they
+         * are on. For the BTree and Tiered layouts the primes are part of the nodes, and the Partitioned layout keeps
+         * them in their own vector as elements, so for all three this is 0
+         * @return size_type - the number of bytes
+         */
+        size_type primeIndexMemory() const;
+
         /**
          * @brief Returns the size of the int_container vector - the main vector of the integers in the container
          * @return int - the size of the container
@@ -51,41 +276,202 @@ namespace ariel{
         int size() const;
 
         /**
-         * @brief Returns the size of the prime_indexes vector
-         * @return int - the size of the prime_indexes vector
+         * @brief Returns the number of prime numbers in the container
+         * @return int - the number of set bits in the prime_bitmap
          */
         int p_size() const;
 
         /**
          * @brief Returns the element in the index elm in the int_container vector
          * @param elm The index of the element to return
-         * @return int - the element in the index elm in the int_container vector
+         * @return const int& - the element in the index elm in the int_container vector, valid until the container
+         * is modified
          */
-        int at(size_type elm) const;
+        const int& at(size_type elm) const;
 
         /**
-         * @brief Returns the element in the index elm in the int_container vector, according to the prime_indexes vector.
+         * @brief Returns the index in the int_container vector of the elm'th prime number, a select on the prime_bitmap.
          * This function iterates over the prime numbers only in the container
          * @param elm The index of the element to return
          * @return int - the element in the index elm in the int_container vector
          */
         int p_at(size_type elm) const;
 
+        /**
+         * @brief Returns the elm'th prime number itself, at(p_at(elm)) in one step
+         * @param elm The index of the prime to return
+         * @return const int& - the prime, valid until the container is modified
+         * @throws out_of_range if elm >= p_size()
+         * @complexity O(1) with the materialized primes, a select otherwise
+         */
+        const int& p_value(size_type elm) const;
+
         /**
          * @brief Adds an element to the container
+         * Only the new element is tested for primality, the prime bits after it are shifted by one
          * @param elm The element to add
-         * @complexity O(n)
+         * @complexity O(n), O(log(n)) with the BTree layout, O(sqrt(n)) with the Tiered layout
          */
         void addElement(int elm);
 
+        /**
+         * @brief Adds all the elements of a range to the container
+         * @param first, last The range of the elements to add
+         * @complexity O(n + k*log(k)) for n elements in the container and k in the range, O(k*n) for a small batch
+         */
+        template<typename InputIt>
+        void addElements(InputIt first, InputIt last) {
+            mergeBatch(vector<int>(first, last));
+        }
+
+        /**
+         * @brief Adds all the elements of a span to the container
+         * @param elms The elements to add
+         * @complexity O(n + k*log(k)) for n elements in the container and k in the span, O(k*n) for a small batch
+         */
+        void addElements(std::span<const int> elms);
+
         /**
          * @brief Removes an element from the container
          * @param elm The element to remove
          * @return int - the number of elements removed
-         * @complexity O(log(n))
+         * @throws runtime_error if the element is not in the container
+         * @complexity O(log(n)) to find the element, O(n) to shift the tail. O(log(n)) with the BTree layout,
+         * O(sqrt(n)) with the Tiered layout
          */
         int removeElement(int elm);
 
+        /**
+         * @brief Removes an element from the container, without throwing when it is missing
+         * The element is found by binary search and its bit is erased from the prime_bitmap
+         * @param elm The element to remove
+         * @return int - the number of elements removed, 0 if the element is not in the container
+         * @complexity O(log(n)) to find the element, O(n) to shift the tail. O(log(n)) with the BTree layout,
+         * O(sqrt(n)) with the Tiered layout
+         */
+        int tryRemoveElement(int elm);
+
+        /**
+         * @brief Removes a batch of elements from the container, one occurrence for every value in the batch
+         * Values that are not in the container are ignored. A small batch (see smallBatch) is removed with
+         * tryRemoveElement, a larger one in a single sweep. A sweep measured as 35 to 160 single removes with -O2
+         * at n = 1e4 to 1e6, so the addElements thresholds hold for removes too
+         * @param elms The elements to remove, in any order
+         * @return int - the number of elements removed
+         * @complexity O(n + k*log(k)) for n elements in the container and k in the batch, O(k*n) for a small batch
+         */
+        int removeElements(std::span<const int> elms);
+
+        /**
+         * @brief Removes every element that satisfies a predicate
+         * int_container is compacted and prime_bitmap is rebuilt in the same linear sweep (with the lazy prime index
+         * the bits are left for refreshPrimes, from the first removed element on). The predicate is called
+         * once per element, in ascending order
+         * @param pred A predicate on the element's value
+         * @return int - the number of elements removed
+         * @complexity O(n)
+         */
+        template<typename Predicate>
+        int erase_if(Predicate pred) {
+            if (storage) {
+                unpackStorage();
+            }
+            size_type write = 0;
+            PrimeBitmap kept_primes;
+            if (!lazy_primes) {
+                kept_primes.reserve(int_container.size());
+            }
+            for (size_type read = 0; read < int_container.size(); read++) {
+                if (pred(int_container[read])) {
+                    // Only the first removal finds write == read, everything from there on moves
+                    if (lazy_primes && write == read && read < primes_valid) {
+                        primes_valid = read;
+                    }
+                    continue;
+                }
+                if (!lazy_primes) {
+                    kept_primes.push_back(prime_bitmap.test(read));
+                }
+                int_container[write++] = int_container[read];
+            }
+            int removed = (int)(int_container.size() - write);
+            int_container.resize(write);
+            if (!lazy_primes) {
+                prime_bitmap = std::move(kept_primes);
+                if (materialized_primes) {
+                    rebuildPrimeValues();
+                }
+            }
+            if (storage) {
+                repackStorage();
+            }
+            return removed;
+        }
+
+        /**
+         * @brief Calls f on every element in the given order, without constructing iterators
+         * The loop is a template on the order, so it is inlined into the caller together with f. With the vector
+         * layout, ascending order is a plain loop over int_container, prime order walks the words of prime_bitmap
+         * and reads the set positions (so int_container is still read front to back, which the hardware
+         * prefetcher follows), and cross order closes in from both ends of int_container
+         * @param f Called with every element, as f(int)
+         * @complexity O(n), O(p*log(n)) in prime order with the BTree and Tiered layouts for p primes
+         */
+        template<Order order, typename F>
+        void for_each(F&& f) const {
+            if (storage) {
+                size_type count = (order == Order::Prime) ? storage->primeCount() : storage->size();
+                for (size_type k = 0; k < count;) {
+                    if constexpr (order == Order::Ascending) {
+                        for (int elm : storage->runAt(k)) {
+                            f(elm);
+                            k++;
+                        }
+                    }
+                    else if constexpr (order == Order::Prime) {
+                        f(storage->primeValue(k++));
+                    }
+                    else {
+                        f(storage->at((k % 2 == 0) ? k / 2 : count - 1 - k / 2));
+                        k++;
+                    }
+                }
+                return;
+            }
+            const int* elms = int_container.data();
+            size_type count = int_container.size();
+            if constexpr (order == Order::Ascending) {
+                for (size_type i = 0; i < count; i++) {
+                    f(elms[i]);
+                }
+            }
+            else if constexpr (order == Order::Prime) {
+                refreshPrimes();
+                if (materialized_primes) {
+                    for (int prime : prime_values) {
+                        f(prime);
+                    }
+                    return;
+                }
+                const std::vector<uint64_t>& words = prime_bitmap.data();
+                for (size_type w = 0; w < words.size(); w++) {
+                    for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+                        f(elms[w * 64 + (size_type)std::countr_zero(bits)]);
+                    }
+                }
+            }
+            else {
+                size_type low = 0;
+                size_type high = count;
+                while (low < high) {
+                    f(elms[low++]);
+                    if (low < high) {
+                        f(elms[--high]);
+                    }
+                }
+            }
+        }
+
         /**
          * @brief Prints the container (only the int_container vector)
          */
@@ -114,69 +500,142 @@ namespace ariel{
 
         /**
          * @brief AscendingIterator class - an iterator that iterates over the container in an ascending order
+         * @tparam Checks - the checking policy, Checked or Unchecked (see the typedefs after the class)
          */
-        class AscendingIterator {
+        template<typename Checks>
+        class BasicAscendingIterator {
             /**
              * The iterator is implemented as an index to the container
              * It's fields are:
-             * _container - a reference to the MagicalContainer that the iterator iterates over
+             * _container - a pointer to the MagicalContainer that the iterator iterates over. Iterators are bound to
+             * their container by identity, so copying, assigning and comparing them is O(1)
              * current_index - the index of the iterator in the container
              */
-            MagicalContainer& _container;
+            const MagicalContainer* _container;
             int current_index;
 
+        public:
             /**
-             * @brief A private constructor for the AscendingIterator class
-             * @param container - a reference to the MagicalContainer that the iterator iterates over
-             * @param index - an index of an int in the container. the iterator will point on this index
-             * @throws out_of_range if the index is out of range
+             * The iterator models std::random_access_iterator. It doesn't model std::contiguous_iterator, because the
+             * BTree and Tiered layouts don't keep the elements in one array
              */
-            AscendingIterator(MagicalContainer &container, int index);
-        public:
+            typedef std::random_access_iterator_tag iterator_concept;
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef int value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const int* pointer;
+            typedef const int& reference;
+
+            /**
+             * @brief A default constructor, for the standard iterator concepts. The iterator isn't bound to any
+             * container until another iterator is assigned to it
+             */
+            BasicAscendingIterator();
+
             /**
              * @brief A constructor for the AscendingIterator class
              * @param container - a reference to the MagicalContainer that the iterator iterates over
              * At the beginning, the iterator will point to the first element in the container
              */
-            AscendingIterator(MagicalContainer& container);
+            BasicAscendingIterator(MagicalContainer& container);
+
+            /**
+             * @brief A constructor for the AscendingIterator class that points the iterator at a position
+             * @param container - a reference to the MagicalContainer that the iterator iterates over
+             * @param index - a position in the container, from 0 to size()
+             * @throws out_of_range if the index is out of range, unless the iterators are unchecked
+             */
+            BasicAscendingIterator(const MagicalContainer& container, int index);
 
             /**
              * @brief A copy constructor for the AscendingIterator class
              * @param other - the AscendingIterator to copy
              */
-            AscendingIterator(const AscendingIterator& other);
+            BasicAscendingIterator(const BasicAscendingIterator& other);
 
             /**
              * For the rule of 5
              */
-            ~AscendingIterator() = default;
-            AscendingIterator(AscendingIterator&& other) = default;
-            AscendingIterator& operator=(AscendingIterator&& other) = delete;
+            ~BasicAscendingIterator() = default;
+            BasicAscendingIterator(BasicAscendingIterator&& other) = default;
+            BasicAscendingIterator& operator=(BasicAscendingIterator&& other);
 
             /**
              * @brief Returns an iterator to the first element in the container
              * @return AscendingIterator - an iterator to the first element in the container
              */
-            AscendingIterator begin();
+            BasicAscendingIterator begin();
 
             /**
              * @brief Returns an iterator to the last element in the container
              * @return AscendingIterator - an iterator to the last element in the container
              */
-            AscendingIterator end();
+            BasicAscendingIterator end();
+
+            /**
+             * @brief Sentinel - the end of the iteration as a bare position, for loops and ranges that don't need a
+             * full iterator at the end. Comparing an iterator with it is a single int compare, and it doesn't call
+             * back into the container
+             */
+            struct Sentinel {
+                int bound;
+            };
+
+            /**
+             * @brief Returns a sentinel for the end of the iteration, with the number of elements cached in it.
+             * end() keeps returning an iterator, for the algorithms that need both ends to have the same type
+             * @return Sentinel - the end of the iteration, valid until the container is modified
+             * @complexity O(1)
+             */
+            Sentinel sentinel() const {
+                return Sentinel{_container->size()};
+            }
+
+            /**
+             * @brief Compares the iterator with the end of the iteration. != and the reversed forms are rewritten
+             * from this one
+             * @return true if the iterator is at the end, false otherwise
+             */
+            bool operator==(const Sentinel& end) const {
+                return current_index == end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions from the end to the iterator, <= 0
+             */
+            difference_type operator-(const Sentinel& end) const {
+                return current_index - end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions left until the end
+             */
+            friend difference_type operator-(const Sentinel& end, const BasicAscendingIterator& iter) {
+                return end.bound - iter.current_index;
+            }
 
             /**
              * @brief Returns the element in the current index of the iterator
-             * @return int - the element in the current index of the iterator
+             * @return const int& - the element in the current index of the iterator
+             * @throws out_of_range if the iterator is at the end, unless the iterators are unchecked
              */
-            int operator*() const;
+            const int& operator*() const {
+                if constexpr (Checks::checks) {
+                    return _container->at((size_type)current_index);
+                }
+                else {
+                    return _container->atUnchecked((size_type)current_index);
+                }
+            }
 
             /**
              * @brief Overloading the == operator to compare between two AscendingIterators
              * @param other - The AscendingIterator to compare to
              * @return true if the two iterators are equal, false otherwise
              */
-            bool operator==(const AscendingIterator& other) const;
+            bool operator==(const BasicAscendingIterator& other) const {
+                return current_index == other.current_index;
+            }
 
             /**
              * @brief Overloading the != operator to compare between two AscendingIterators
@@ -184,279 +643,889 @@ namespace ariel{
              * @return true if the two iterators are not equal, false otherwise
              * @complexity O(1)
              */
-            bool operator!=(const AscendingIterator& other) const;
+            bool operator!=(const BasicAscendingIterator& other) const {
+                return current_index != other.current_index;
+            }
 
             /**
              * @brief Overloading the < operator to compare between two AscendingIterators
              * @param other - The AscendingIterator to compare to
              * @return true if the current iterator is smaller than the other iterator, false otherwise
              */
-            bool operator<(const AscendingIterator& other) const;
+            bool operator<(const BasicAscendingIterator& other) const;
 
             /**
              * @brief Overloading the > operator to compare between two AscendingIterators
              * @param other - The AscendingIterator to compare to
              * @return true if the current iterator is bigger than the other iterator, false otherwise
              */
-            bool operator>(const AscendingIterator& other) const;
+            bool operator>(const BasicAscendingIterator& other) const;
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return AscendingIterator& - the iterator after the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws runtime_error when trying to increment an iterator when it's at the end of the container, unless
+             * the iterators are unchecked
              * @complexity O(1)
              */
-            AscendingIterator& operator++(); // prefix
+            BasicAscendingIterator& operator++() { // prefix
+                if constexpr (Checks::checks) {
+                    if (current_index >= _container->size()) {
+                        throw std::runtime_error("out of range");
+                    }
+                }
+                current_index++;
+                return *this;
+            }
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return AscendingIterator - the iterator before the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws out_of_range when trying to increment an iterator when it's at the end of the container,
+             * unless the iterators are unchecked
              * @complexity O(1)
              */
-            const AscendingIterator operator++(int); // postfix
+            BasicAscendingIterator operator++(int); // postfix
 
             /**
              * @brief Overloading the = operator to assign an AscendingIterator to another AscendingIterator
              * @param other - The AscendingIterator to assign to
              * @return AscendingIterator& - The assigned AscendingIterator
+             * @throws runtime_error if the iterators are not from the same container
+             * @complexity O(1)
+             */
+            BasicAscendingIterator& operator=(const BasicAscendingIterator& other);
+
+            /**
+             * @brief Overloading the <= operator to compare between two AscendingIterators
+             * @param other - The AscendingIterator to compare to
+             * @return true if the current iterator is not bigger than the other iterator, false otherwise
+             */
+            bool operator<=(const BasicAscendingIterator& other) const;
+
+            /**
+             * @brief Overloading the >= operator to compare between two AscendingIterators
+             * @param other - The AscendingIterator to compare to
+             * @return true if the current iterator is not smaller than the other iterator, false otherwise
+             */
+            bool operator>=(const BasicAscendingIterator& other) const;
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return AscendingIterator& - the iterator after the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator& operator--(); // prefix
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return AscendingIterator - the iterator before the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator operator--(int); // postfix
+
+            /**
+             * @brief Moves the iterator forward by steps positions of the container
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return AscendingIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator& operator+=(difference_type steps);
+
+            /**
+             * @brief Moves the iterator backwards by steps positions of the container
+             * @param steps - the number of positions to move, negative to move forward
+             * @return AscendingIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator& operator-=(difference_type steps);
+
+            /**
+             * @brief Returns an iterator steps positions after this one
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return AscendingIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator operator+(difference_type steps) const;
+
+            /**
+             * @brief Returns an iterator steps positions after iter
+             */
+            friend BasicAscendingIterator operator+(difference_type steps, const BasicAscendingIterator& iter) {
+                return iter + steps;
+            }
+
+            /**
+             * @brief Returns an iterator steps positions before this one
+             * @param steps - the number of positions to move, negative to move forward
+             * @return AscendingIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicAscendingIterator operator-(difference_type steps) const;
+
+            /**
+             * @brief Returns the distance between two iterators of the same container
+             * @param other - the AscendingIterator to measure from
+             * @return difference_type - the number of positions from other to this iterator
+             * @complexity O(1)
+             */
+            difference_type operator-(const BasicAscendingIterator& other) const;
+
+            /**
+             * @brief Returns the element steps positions after the iterator
+             * @param steps - the distance from the iterator
+             * @return const int& - the element at that position
+             * @throws out_of_range if the position is outside the container, unless the iterators are unchecked
+             * @complexity O(1)
              */
-            AscendingIterator& operator=(const AscendingIterator& other);
+            const int& operator[](difference_type steps) const;
         };
 
+        typedef BasicAscendingIterator<Checked> AscendingIterator;
+        typedef BasicAscendingIterator<Unchecked> UncheckedAscendingIterator;
+
         /**
          * @brief PrimeIterator class - an iterator that iterates over all the prime numbers in the container
+         * @tparam Checks - the checking policy, Checked or Unchecked (see the typedefs after the class)
          */
-        class PrimeIterator {
+        template<typename Checks>
+        class BasicPrimeIterator {
             /**
              * The iterator is implemented as an index to the container
              * The prime index is the index of the prime number in the container. For example, if the container contains
              * [1, 2, 3, 4, 5, 6, 7, 8, 9, 10] then the prime indexes are [1, 2, 4, 6]
              * current index = 0 in the iterator means that the iterator will actually point to int_container[1] = 2
              * It's fields are:
-             * _container - a reference to the MagicalContainer that the iterator iterates over
+             * _container - a pointer to the MagicalContainer that the iterator iterates over. Iterators are bound to
+             * their container by identity, so copying, assigning and comparing them is O(1)
              * current_index - the index of the iterator in the container
              */
-            MagicalContainer& _container;
+            const MagicalContainer* _container;
             int current_index;
 
+        public:
             /**
-             * @brief A private constructor for the PrimeIterator class
-             * @param container - a reference to the MagicalContainer that the iterator iterates over
-             * @param index - an index of an int in the container. the iterator will point on this index
-             * @throws out_of_range if the index is out of range
+             * The iterator models std::random_access_iterator. It doesn't model std::contiguous_iterator, because the
+             * BTree and Tiered layouts don't keep the elements in one array
              */
-            PrimeIterator(MagicalContainer& container, int index);
-        public:
+            typedef std::random_access_iterator_tag iterator_concept;
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef int value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const int* pointer;
+            typedef const int& reference;
+
+            /**
+             * @brief A default constructor, for the standard iterator concepts. The iterator isn't bound to any
+             * container until another iterator is assigned to it
+             */
+            BasicPrimeIterator();
+
             /**
              * @brief A constructor for the PrimeIterator class
              * @param container - a reference to the MagicalContainer that the iterator iterates over
              * At the beginning, the iterator will point to the first prime number in the container
              */
-            PrimeIterator(MagicalContainer& container);
+            BasicPrimeIterator(MagicalContainer& container);
+
+            /**
+             * @brief A constructor for the PrimeIterator class that points the iterator at a position
+             * @param container - a reference to the MagicalContainer that the iterator iterates over
+             * @param index - a position among the prime numbers, from 0 to p_size()
+             * @throws out_of_range if the index is out of range, unless the iterators are unchecked
+             */
+            BasicPrimeIterator(const MagicalContainer& container, int index);
 
             /**
              * @brief A copy constructor for the PrimeIterator class
              * @param other - the PrimeIterator to copy
              */
-            PrimeIterator(const PrimeIterator& other);
+            BasicPrimeIterator(const BasicPrimeIterator& other);
 
             /**
              * For the rule of 5
              */
-            ~PrimeIterator() = default;
-            PrimeIterator(PrimeIterator&& other) = default;
-            PrimeIterator& operator=(PrimeIterator&& other) = delete;
+            ~BasicPrimeIterator() = default;
+            BasicPrimeIterator(BasicPrimeIterator&& other) = default;
+            BasicPrimeIterator& operator=(BasicPrimeIterator&& other);
 
             /**
              * @brief Returns an iterator to the first prime number in the container
              * @return PrimeIterator - an iterator to the first prime number in the container
              */
-            PrimeIterator begin();
+            BasicPrimeIterator begin();
 
             /**
              * @brief Returns an iterator to the last prime number in the container
              * @return PrimeIterator - an iterator to the last prime number in the container
              */
-            PrimeIterator end();
+            BasicPrimeIterator end();
+
+            /**
+             * @brief Sentinel - the end of the iteration as a bare position, for loops and ranges that don't need a
+             * full iterator at the end. Comparing an iterator with it is a single int compare, and it doesn't call
+             * back into the container
+             */
+            struct Sentinel {
+                int bound;
+            };
+
+            /**
+             * @brief Returns a sentinel for the end of the iteration, with the number of prime numbers cached in it.
+             * end() keeps returning an iterator, for the algorithms that need both ends to have the same type
+             * @return Sentinel - the end of the iteration, valid until the container is modified
+             * @complexity O(1)
+             */
+            Sentinel sentinel() const {
+                return Sentinel{_container->p_size()};
+            }
+
+            /**
+             * @brief Compares the iterator with the end of the iteration. != and the reversed forms are rewritten
+             * from this one
+             * @return true if the iterator is at the end, false otherwise
+             */
+            bool operator==(const Sentinel& end) const {
+                return current_index == end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions from the end to the iterator, <= 0
+             */
+            difference_type operator-(const Sentinel& end) const {
+                return current_index - end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions left until the end
+             */
+            friend difference_type operator-(const Sentinel& end, const BasicPrimeIterator& iter) {
+                return end.bound - iter.current_index;
+            }
 
             /**
              * @brief Returns the prime number in the current index of the iterator
-             * @return int - the prime number in the current index of the iterator
+             * @return const int& - the prime number in the current index of the iterator
+             * @throws out_of_range if the iterator is at the end, unless the iterators are unchecked
              */
-            int operator*() const;
+            const int& operator*() const {
+                if constexpr (Checks::checks) {
+                    if (current_index >= _container->p_size()) {
+                        throw std::out_of_range("BasicPrimeIterator: iterator out of range");
+                    }
+                    return _container->p_value((size_type)current_index);
+                }
+                else {
+                    return _container->primeUnchecked((size_type)current_index);
+                }
+            }
 
             /**
              * @brief Overloading the == operator to compare between two PrimeIterators
              * @param other - The PrimeIterator to compare to
              * @return true if the two iterators are equal, false otherwise
              */
-            bool operator==(const PrimeIterator& other) const;
+            bool operator==(const BasicPrimeIterator& other) const {
+                return current_index == other.current_index;
+            }
 
             /**
              * @brief Overloading the != operator to compare between two PrimeIterators
              * @param other - The PrimeIterator to compare to
              * @return true if the two iterators are not equal, false otherwise
              */
-            bool operator!=(const PrimeIterator& other) const;
+            bool operator!=(const BasicPrimeIterator& other) const {
+                return current_index != other.current_index;
+            }
 
             /**
              * @brief Overloading the < operator to compare between two PrimeIterators
              * @param other - The PrimeIterator to compare to
              * @return true if the current iterator is smaller than the other iterator, false otherwise
              */
-            bool operator<(const PrimeIterator& other) const;
+            bool operator<(const BasicPrimeIterator& other) const;
 
             /**
              * @brief Overloading the > operator to compare between two PrimeIterators
              * @param other - The PrimeIterator to compare to
              * @return true if the current iterator is bigger than the other iterator, false otherwise
              */
-            bool operator>(const PrimeIterator& other) const;
+            bool operator>(const BasicPrimeIterator& other) const;
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return PrimeIterator& - the iterator after the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws runtime_error when trying to increment an iterator when it's at the end of the container, unless
+             * the iterators are unchecked
              * @complexity O(1)
              */
-            PrimeIterator& operator++(); // prefix
+            BasicPrimeIterator& operator++() { // prefix
+                if constexpr (Checks::checks) {
+                    if (current_index >= _container->p_size()) {
+                        throw std::runtime_error("BasicPrimeIterator: iterator out of range");
+                    }
+                }
+                current_index++;
+                return *this;
+            }
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return PrimeIterator - the iterator before the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws out_of_range when trying to increment an iterator when it's at the end of the container,
+             * unless the iterators are unchecked
              * @complexity O(1)
              */
-            const PrimeIterator operator++(int); // postfix
+            BasicPrimeIterator operator++(int); // postfix
 
             /**
              * @brief Overloading the = operator to assign a PrimeIterator to another PrimeIterator
              * @param other - The PrimeIterator to assign to
              * @return PrimeIterator& - The assigned PrimeIterator
+             * @throws runtime_error if the iterators are not from the same container
+             * @complexity O(1)
+             */
+            BasicPrimeIterator& operator=(const BasicPrimeIterator& other);
+
+            /**
+             * @brief Overloading the <= operator to compare between two PrimeIterators
+             * @param other - The PrimeIterator to compare to
+             * @return true if the current iterator is not bigger than the other iterator, false otherwise
+             */
+            bool operator<=(const BasicPrimeIterator& other) const;
+
+            /**
+             * @brief Overloading the >= operator to compare between two PrimeIterators
+             * @param other - The PrimeIterator to compare to
+             * @return true if the current iterator is not smaller than the other iterator, false otherwise
+             */
+            bool operator>=(const BasicPrimeIterator& other) const;
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return PrimeIterator& - the iterator after the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator& operator--(); // prefix
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return PrimeIterator - the iterator before the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator operator--(int); // postfix
+
+            /**
+             * @brief Moves the iterator forward by steps positions of the prime numbers of the container
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return PrimeIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator& operator+=(difference_type steps);
+
+            /**
+             * @brief Moves the iterator backwards by steps positions of the prime numbers of the container
+             * @param steps - the number of positions to move, negative to move forward
+             * @return PrimeIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator& operator-=(difference_type steps);
+
+            /**
+             * @brief Returns an iterator steps positions after this one
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return PrimeIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator operator+(difference_type steps) const;
+
+            /**
+             * @brief Returns an iterator steps positions after iter
+             */
+            friend BasicPrimeIterator operator+(difference_type steps, const BasicPrimeIterator& iter) {
+                return iter + steps;
+            }
+
+            /**
+             * @brief Returns an iterator steps positions before this one
+             * @param steps - the number of positions to move, negative to move forward
+             * @return PrimeIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicPrimeIterator operator-(difference_type steps) const;
+
+            /**
+             * @brief Returns the distance between two iterators of the same container
+             * @param other - the PrimeIterator to measure from
+             * @return difference_type - the number of positions from other to this iterator
+             * @complexity O(1)
+             */
+            difference_type operator-(const BasicPrimeIterator& other) const;
+
+            /**
+             * @brief Returns the prime number steps positions after the iterator
+             * Reads it with p_value like operator*, so it[k] is the same element as *(it + k)
+             * @param steps - the distance from the iterator
+             * @return const int& - the prime number at that position
+             * @throws out_of_range if the position is outside the prime numbers of the container, unless the
+             * iterators are unchecked
+             * @complexity O(1) with the materialized primes, a select otherwise
              */
-            PrimeIterator& operator=(const PrimeIterator& other);
+            const int& operator[](difference_type steps) const;
         };
 
+        typedef BasicPrimeIterator<Checked> PrimeIterator;
+        typedef BasicPrimeIterator<Unchecked> UncheckedPrimeIterator;
+
         /**
          * @brief SideCrossIterator class - an iterator that iterates over all the numbers in the container
          * in the following order: [first, last, second, second last, third, third last, ...]
+         * @tparam Checks - the checking policy, Checked or Unchecked (see the typedefs after the class)
          */
-        class SideCrossIterator {
+        template<typename Checks>
+        class BasicSideCrossIterator {
             /**
-             * The iterator is implemented as an index to the container
+             * The iterator is implemented as a position in the cross sequence
              * It's fields are:
-             * The current index - is the index of the iterator in the container
-             * _container - a reference to the MagicalContainer that the iterator iterates over
-             * start_or_end - a boolean that indicates if the iterator is at the start or at the end of the container
-             * index_from_start - the index of the iterator from the start of the container
-             * index_from_end - the index of the iterator from the end of the container
-             */
-            MagicalContainer& _container;
-            bool start_or_end;
-            int index_from_start;
-            int index_from_end;
+             * _container - a pointer to the MagicalContainer that the iterator iterates over. Iterators are bound to
+             * their container by identity, so copying, assigning and comparing them is O(1)
+             * current_index - the position k of the iterator in the order [first, last, second, second last, ...].
+             * The element it points to is at index k/2 when k is even and at index size-1-k/2 when k is odd, so
+             * moving the iterator by any distance is O(1)
+             */
+            const MagicalContainer* _container;
             int current_index;
 
             /**
-             * @brief A private constructor for the SideCrossIterator class
-             * @param container - a reference to the MagicalContainer that the iterator iterates over
-             * @param index - an index of an int in the container. the iterator will point on this index
-             * @throws out_of_range if the index is out of range
+             * @brief Returns the index in the container of the element at position k of the cross sequence
+             * @param k The position in the cross sequence
+             * @return size_type - the index of the element in ascending order
              */
-            SideCrossIterator(MagicalContainer& container, int index);
+            size_type indexAt(int k) const {
+                auto pos = (size_type)k;
+                return (pos % 2 == 0) ? pos / 2 : (size_type)_container->size() - 1 - pos / 2;
+            }
+
         public:
+            /**
+             * The iterator models std::random_access_iterator. It doesn't model std::contiguous_iterator, because the
+             * BTree and Tiered layouts don't keep the elements in one array
+             */
+            typedef std::random_access_iterator_tag iterator_concept;
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef int value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const int* pointer;
+            typedef const int& reference;
+
+            /**
+             * @brief A default constructor, for the standard iterator concepts. The iterator isn't bound to any
+             * container until another iterator is assigned to it
+             */
+            BasicSideCrossIterator();
+
             /**
              * @brief A constructor for the SideCrossIterator class
              * @param container - a reference to the MagicalContainer that the iterator iterates over
              * At the beginning, the iterator will point to the first int in the container
              */
-            SideCrossIterator(MagicalContainer& container);
+            BasicSideCrossIterator(MagicalContainer& container);
+
+            /**
+             * @brief A constructor for the SideCrossIterator class that points the iterator at a position
+             * @param container - a reference to the MagicalContainer that the iterator iterates over
+             * @param index - a position in the cross order, from 0 to size()
+             * @throws out_of_range if the index is out of range, unless the iterators are unchecked
+             */
+            BasicSideCrossIterator(const MagicalContainer& container, int index);
 
             /**
              * @brief A copy constructor for the SideCrossIterator class
              * @param other - the SideCrossIterator to copy
              */
-            SideCrossIterator(const SideCrossIterator& other);
+            BasicSideCrossIterator(const BasicSideCrossIterator& other);
 
             /**
              * For the rule of 5
              */
-            ~SideCrossIterator() = default;
-            SideCrossIterator(SideCrossIterator&& other) = default;
-            SideCrossIterator& operator=(SideCrossIterator&& other) = delete;
+            ~BasicSideCrossIterator() = default;
+            BasicSideCrossIterator(BasicSideCrossIterator&& other) = default;
+            BasicSideCrossIterator& operator=(BasicSideCrossIterator&& other);
 
             /**
              * @brief Returns an iterator to the first int in the container
              * @return SideCrossIterator - an iterator to the first int in the container
              */
-            SideCrossIterator begin();
+            BasicSideCrossIterator begin();
 
             /**
              * @brief Returns an iterator to the last int in the container
              * @return SideCrossIterator - an iterator to the last int in the container
              */
-            SideCrossIterator end();
+            BasicSideCrossIterator end();
+
+            /**
+             * @brief Sentinel - the end of the iteration as a bare position, for loops and ranges that don't need a
+             * full iterator at the end. Comparing an iterator with it is a single int compare, and it doesn't call
+             * back into the container
+             */
+            struct Sentinel {
+                int bound;
+            };
+
+            /**
+             * @brief Returns a sentinel for the end of the iteration, with the number of elements cached in it.
+             * end() keeps returning an iterator, for the algorithms that need both ends to have the same type
+             * @return Sentinel - the end of the iteration, valid until the container is modified
+             * @complexity O(1)
+             */
+            Sentinel sentinel() const {
+                return Sentinel{_container->size()};
+            }
+
+            /**
+             * @brief Compares the iterator with the end of the iteration. != and the reversed forms are rewritten
+             * from this one
+             * @return true if the iterator is at the end, false otherwise
+             */
+            bool operator==(const Sentinel& end) const {
+                return current_index == end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions from the end to the iterator, <= 0
+             */
+            difference_type operator-(const Sentinel& end) const {
+                return current_index - end.bound;
+            }
+
+            /**
+             * @return difference_type - the number of positions left until the end
+             */
+            friend difference_type operator-(const Sentinel& end, const BasicSideCrossIterator& iter) {
+                return end.bound - iter.current_index;
+            }
 
             /**
              * @brief Returns the int in the current index of the iterator
-             * @return int - the int in the current index of the iterator
+             * @return const int& - the int in the current index of the iterator
+             * @throws out_of_range if the iterator is at the end, unless the iterators are unchecked
              */
-            int operator*() const;
+            const int& operator*() const {
+                if constexpr (Checks::checks) {
+                    if (current_index >= _container->size()) {
+                        throw std::out_of_range("BasicSideCrossIterator: iterator out of range");
+                    }
+                    return _container->at(indexAt(current_index));
+                }
+                else {
+                    return _container->atUnchecked(indexAt(current_index));
+                }
+            }
 
             /**
              * @brief Overloading the == operator to compare between two SideCrossIterators
              * @param other - The SideCrossIterator to compare to
              * @return true if the two iterators are equal, false otherwise
              */
-            bool operator==(const SideCrossIterator &other) const;
+            bool operator==(const BasicSideCrossIterator& other) const {
+                return current_index == other.current_index;
+            }
 
             /**
              * @brief Overloading the != operator to compare between two SideCrossIterators
              * @param other - The SideCrossIterator to compare to
              * @return true if the two iterators are not equal, false otherwise
              */
-            bool operator!=(const SideCrossIterator &other) const;
+            bool operator!=(const BasicSideCrossIterator& other) const {
+                return current_index != other.current_index;
+            }
 
             /**
              * @brief Overloading the < operator to compare between two SideCrossIterators
              * @param other - The SideCrossIterator to compare to
              * @return true if the current iterator is smaller than the other iterator, false otherwise
              */
-            bool operator<(const SideCrossIterator &other) const;
+            bool operator<(const BasicSideCrossIterator &other) const;
 
             /**
              * @brief Overloading the > operator to compare between two SideCrossIterators
              * @param other - The SideCrossIterator to compare to
              * @return true if the current iterator is bigger than the other iterator, false otherwise
              */
-            bool operator>(const SideCrossIterator &other) const;
+            bool operator>(const BasicSideCrossIterator &other) const;
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return SideCrossIterator& - the iterator after the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws out_of_range when trying to increment an iterator when it's at the end of the container,
+             * unless the iterators are unchecked
              * @complexity O(1)
              */
-            const SideCrossIterator operator++(int); // postfix
+            BasicSideCrossIterator operator++(int); // postfix
 
             /**
              * @brief Overloading the ++ operator to increase the iterator by 1
              * @return SideCrossIterator - the iterator before the increase
-             * @throws out_of_range when trying to increment an iterator when it's at the end of the container
+             * @throws runtime_error when trying to increment an iterator when it's at the end of the container, unless
+             * the iterators are unchecked
              * @complexity O(1)
              */
-            SideCrossIterator& operator++(); // prefix
+            BasicSideCrossIterator& operator++() { // prefix
+                if constexpr (Checks::checks) {
+                    if (current_index >= _container->size()) {
+                        throw std::runtime_error("BasicSideCrossIterator: iterator out of range");
+                    }
+                }
+                current_index++;
+                return *this;
+            }
 
             /**
              * @brief Overloading the = operator to assign a SideCrossIterator to another SideCrossIterator
              * @param other - The SideCrossIterator to assign to
              * @return SideCrossIterator& - The assigned SideCrossIterator
+             * @throws runtime_error if the iterators are not from the same container
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator& operator=(const BasicSideCrossIterator &other);
+
+            /**
+             * @brief Overloading the <= operator to compare between two SideCrossIterators
+             * @param other - The SideCrossIterator to compare to
+             * @return true if the current iterator is not bigger than the other iterator, false otherwise
+             */
+            bool operator<=(const BasicSideCrossIterator& other) const;
+
+            /**
+             * @brief Overloading the >= operator to compare between two SideCrossIterators
+             * @param other - The SideCrossIterator to compare to
+             * @return true if the current iterator is not smaller than the other iterator, false otherwise
+             */
+            bool operator>=(const BasicSideCrossIterator& other) const;
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return SideCrossIterator& - the iterator after the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator& operator--(); // prefix
+
+            /**
+             * @brief Overloading the -- operator to decrease the iterator by 1
+             * @return SideCrossIterator - the iterator before the decrease
+             * @throws runtime_error when trying to decrement an iterator when it's at the beginning, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator operator--(int); // postfix
+
+            /**
+             * @brief Moves the iterator forward by steps positions of the cross sequence
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return SideCrossIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator& operator+=(difference_type steps);
+
+            /**
+             * @brief Moves the iterator backwards by steps positions of the cross sequence
+             * @param steps - the number of positions to move, negative to move forward
+             * @return SideCrossIterator& - the iterator after the move
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
              */
-            SideCrossIterator& operator=(const SideCrossIterator &other);
+            BasicSideCrossIterator& operator-=(difference_type steps);
 
+            /**
+             * @brief Returns an iterator steps positions after this one
+             * @param steps - the number of positions to move, negative to move backwards
+             * @return SideCrossIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator operator+(difference_type steps) const;
+
+            /**
+             * @brief Returns an iterator steps positions after iter
+             */
+            friend BasicSideCrossIterator operator+(difference_type steps, const BasicSideCrossIterator& iter) {
+                return iter + steps;
+            }
+
+            /**
+             * @brief Returns an iterator steps positions before this one
+             * @param steps - the number of positions to move, negative to move forward
+             * @return SideCrossIterator - the moved iterator
+             * @throws out_of_range if the new position is before the beginning or after the end, unless the
+             * iterators are unchecked
+             * @complexity O(1)
+             */
+            BasicSideCrossIterator operator-(difference_type steps) const;
+
+            /**
+             * @brief Returns the distance between two iterators of the same container
+             * @param other - the SideCrossIterator to measure from
+             * @return difference_type - the number of positions from other to this iterator
+             * @complexity O(1)
+             */
+            difference_type operator-(const BasicSideCrossIterator& other) const;
+
+            /**
+             * @brief Returns the int steps positions after the iterator
+             * @param steps - the distance from the iterator
+             * @return const int& - the int at that position
+             * @throws out_of_range if the position is outside the cross sequence, unless the iterators are unchecked
+             * @complexity O(1)
+             */
+            const int& operator[](difference_type steps) const;
         };
 
+        typedef BasicSideCrossIterator<Checked> SideCrossIterator;
+        typedef BasicSideCrossIterator<Unchecked> UncheckedSideCrossIterator;
+
+        /**
+         * @brief ChunkReader class - walks the container in one of the three orders, a block of elements at a time
+         * Every call to next() returns the next block as a std::span<const int>. In ascending order the blocks point
+         * straight into the storage (int_container, a B+tree leaf or a tiered block), and so do the blocks of the
+         * prime order when the primes are materialized. Otherwise the elements of the prime and cross orders aren't
+         * adjacent in memory, and they are gathered into a buffer supplied by the caller
+         */
+        class ChunkReader {
+            /**
+             * It's fields are:
+             * _container - a pointer to the MagicalContainer that the reader reads
+             * order - the order of the walk
+             * buffer - where the prime and cross orders gather the elements, unused in ascending order
+             * max_len - the longest block next() returns
+             * position - the position in the order of the first element of the next block
+             * bound - the number of elements in the order
+             */
+            const MagicalContainer* _container;
+            Order order;
+            std::span<int> buffer;
+            size_type max_len;
+            size_type position;
+            size_type bound;
+
+        public:
+            /**
+             * @brief A constructor for the ChunkReader class, the reader starts at the beginning of the order
+             * @param container - the MagicalContainer to read
+             * @param order - the order of the walk
+             * @param max_len - the longest block to return
+             * @param buffer - where to gather the elements of the prime and cross orders, can be empty when the
+             * blocks point into the storage. Gathered blocks are never longer than the buffer
+             * @throws invalid_argument if max_len is 0, or if the order needs a buffer and it is empty
+             */
+            ChunkReader(const MagicalContainer& container, Order order, size_type max_len, std::span<int> buffer);
+
+            /**
+             * @brief Returns the next block of elements
+             * @return std::span<const int> - the block, empty when the walk is over. A block that points into the
+             * buffer is overwritten by the next call, and any block is valid only until the container is modified
+             * @complexity O(the length of the block), O(1) in ascending order with the vector layout
+             */
+            std::span<const int> next();
+        };
+
+        /**
+         * The views over the three orders. They are std::ranges::subrange objects from an iterator to its Sentinel,
+         * so they are views, sized_ranges and random_access_ranges, and they compose lazily with std::views
+         * (filter, transform, take, ...) without copying the elements out. The views of the plain names use the
+         * checked iterators
+         */
+        template<typename Checks>
+        using BasicAscendingView = std::ranges::subrange<BasicAscendingIterator<Checks>,
+                                                         typename BasicAscendingIterator<Checks>::Sentinel>;
+        template<typename Checks>
+        using BasicPrimeView = std::ranges::subrange<BasicPrimeIterator<Checks>,
+                                                     typename BasicPrimeIterator<Checks>::Sentinel>;
+        template<typename Checks>
+        using BasicSideCrossView = std::ranges::subrange<BasicSideCrossIterator<Checks>,
+                                                         typename BasicSideCrossIterator<Checks>::Sentinel>;
+        typedef BasicAscendingView<Checked> AscendingView;
+        typedef BasicPrimeView<Checked> PrimeView;
+        typedef BasicSideCrossView<Checked> SideCrossView;
+
+        /**
+         * @brief Returns a view of the elements in ascending order
+         * @tparam Checks - the iterator checking policy, ascending<Unchecked>() for unchecked iterators
+         * @return BasicAscendingView<Checks> - the view, valid until the container is modified
+         * @complexity O(1)
+         */
+        template<typename Checks = Checked>
+        BasicAscendingView<Checks> ascending() {
+            BasicAscendingIterator<Checks> first(*this);
+            return BasicAscendingView<Checks>(first, first.sentinel());
+        }
+
+        /**
+         * @brief Returns a view of the prime numbers in ascending order
+         * @tparam Checks - the iterator checking policy, primes<Unchecked>() for unchecked iterators
+         * @return BasicPrimeView<Checks> - the view, valid until the container is modified
+         * @complexity O(1), plus rebuilding the dirty range of the lazy prime index
+         */
+        template<typename Checks = Checked>
+        BasicPrimeView<Checks> primes() {
+            BasicPrimeIterator<Checks> first(*this);
+            return BasicPrimeView<Checks>(first, first.sentinel());
+        }
+
+        /**
+         * @brief Returns a view of the elements in cross order [first, last, second, second last, ...]
+         * @tparam Checks - the iterator checking policy, side_cross<Unchecked>() for unchecked iterators
+         * @return BasicSideCrossView<Checks> - the view, valid until the container is modified
+         * @complexity O(1)
+         */
+        template<typename Checks = Checked>
+        BasicSideCrossView<Checks> side_cross() {
+            BasicSideCrossIterator<Checks> first(*this);
+            return BasicSideCrossView<Checks>(first, first.sentinel());
+        }
+
+        /**
+         * @brief Returns a reader that walks the container in blocks of up to max_len elements
+         * @param order - the order of the walk
+         * @param max_len - the longest block to return
+         * @param buffer - where to gather the elements of the prime and cross orders (see ChunkReader)
+         * @return ChunkReader - the reader, valid until the container is modified
+         * @throws invalid_argument if max_len is 0, or if the order needs a buffer and it is empty
+         */
+        ChunkReader chunks(Order order, size_type max_len, std::span<int> buffer = {}) const {
+            return ChunkReader(*this, order, max_len, buffer);
+        }
+
     };
 }
 
@@ -0,0 +1,113 @@
+//
+// Created by super on 6/16/23.
+//
+
+#ifndef MAGICAL_ITERATORS_ORDEREDSTORAGE_H
+#define MAGICAL_ITERATORS_ORDEREDSTORAGE_H
+#include <memory>
+#include <span>
+#include <vector>
+#include "PrimeBitmap.hpp"
+
+namespace ariel{
+    /**
+     * @brief OrderedStorage class - an alternative storage layout for the elements of a MagicalContainer
+     * A storage keeps the elements sorted and knows which of them are prime, so it can answer rank queries on all
+     * the elements (for the AscendingIterator and the SideCrossIterator) and on the primes only (for the PrimeIterator).
+     * The default layout of the MagicalContainer is the plain sorted vector and it doesn't use this class
+     */
+    class OrderedStorage {
+    public:
+        OrderedStorage() = default;
+
+        /**
+         * For the rule of 5 - a storage is copied only through clone()
+         */
+        virtual ~OrderedStorage() = default;
+        OrderedStorage(const OrderedStorage& other) = delete;
+        OrderedStorage& operator=(const OrderedStorage& other) = delete;
+        OrderedStorage(OrderedStorage&& other) = delete;
+        OrderedStorage& operator=(OrderedStorage&& other) = delete;
+
+        /**
+         * @return std::size_t - the number of elements in the storage
+         */
+        virtual std::size_t size() const = 0;
+
+        /**
+         * @return std::size_t - the number of prime elements in the storage
+         */
+        virtual std::size_t primeCount() const = 0;
+
+        /**
+         * @brief Returns the element with the given rank in ascending order
+         * @param rank The rank of the element
+         * @return const int& - the element, valid until the storage is modified
+         * @throws out_of_range if rank >= size()
+         */
+        virtual const int& at(std::size_t rank) const = 0;
+
+        /**
+         * @brief Returns the elements stored contiguously from the given rank on, up to the end of the node or block
+         * that holds it
+         * @param rank The rank of the first element of the run
+         * @return std::span<const int> - the run, at least one element long, valid until the storage is modified
+         * @throws out_of_range if rank >= size()
+         */
+        virtual std::span<const int> runAt(std::size_t rank) const = 0;
+
+        /**
+         * @brief Returns the rank of the k'th prime element, the position of the k'th set bit of the vector layout's
+         * prime bitmap
+         * @param k The index of the prime
+         * @return std::size_t - the rank of the prime among all the elements
+         * @throws out_of_range if k >= primeCount()
+         */
+        virtual std::size_t primeRank(std::size_t k) const = 0;
+
+        /**
+         * @brief Returns the k'th prime element itself, at(primeRank(k)) unless a storage can do it in one walk
+         * @param k The index of the prime
+         * @return const int& - the prime, valid until the storage is modified
+         * @throws out_of_range if k >= primeCount()
+         */
+        virtual const int& primeValue(std::size_t k) const {
+            return at(primeRank(k));
+        }
+
+        /**
+         * @brief Inserts an element before all the elements equal to it
+         * @param value The element to insert
+         * @param prime Whether the element is prime
+         */
+        virtual void insert(int value, bool prime) = 0;
+
+        /**
+         * @brief Erases one occurrence of an element
+         * @param value The element to erase
+         * @return true if the element was found and erased, false otherwise
+         */
+        virtual bool erase(int value) = 0;
+
+        /**
+         * @brief Copies all the elements out in the vector layout
+         * @param values Filled with the elements in ascending order
+         * @param primes Filled with one bit per element, set for the primes
+         */
+        virtual void exportTo(std::vector<int>& values, PrimeBitmap& primes) const = 0;
+
+        /**
+         * @brief Replaces the content of the storage with elements given in the vector layout
+         * @param values The elements in ascending order
+         * @param primes One bit per element, set for the primes
+         */
+        virtual void assign(const std::vector<int>& values, const PrimeBitmap& primes) = 0;
+
+        /**
+         * @return std::unique_ptr<OrderedStorage> - a deep copy of the storage
+         */
+        virtual std::unique_ptr<OrderedStorage> clone() const = 0;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_ORDEREDSTORAGE_H
@@ -0,0 +1,121 @@
+//
+// Created by super on 6/24/23.
+//
+
+#include "PartitionedStorage.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+using namespace ariel;
+
+std::size_t PartitionedStorage::size() const {
+    return primes.size() + others.size();
+}
+
+std::size_t PartitionedStorage::primeCount() const {
+    return primes.size();
+}
+
+std::pair<bool, std::size_t> PartitionedStorage::locate(std::size_t rank) const {
+    if (rank >= size()) {
+        throw std::out_of_range("PartitionedStorage: rank out of range");
+    }
+    // The first rank + 1 elements are primes[0, taken) and others[0, rank + 1 - taken). Find the smallest taken
+    // where primes[taken] isn't smaller than the last element taken from others
+    std::size_t count = rank + 1;
+    std::size_t low = count > others.size() ? count - others.size() : 0;
+    std::size_t high = std::min(count, primes.size());
+    while (low < high) {
+        std::size_t taken = (low + high) / 2;
+        std::size_t from_others = count - taken;
+        if (from_others > 0 && primes[taken] < others[from_others - 1]) {
+            low = taken + 1;
+        }
+        else {
+            high = taken;
+        }
+    }
+    std::size_t from_others = count - low;
+    if (low == 0 || (from_others > 0 && others[from_others - 1] > primes[low - 1])) {
+        return {false, from_others - 1};
+    }
+    return {true, low - 1};
+}
+
+const int& PartitionedStorage::at(std::size_t rank) const {
+    auto [in_primes, index] = locate(rank);
+    return in_primes ? primes[index] : others[index];
+}
+
+std::span<const int> PartitionedStorage::runAt(std::size_t rank) const {
+    auto [in_primes, index] = locate(rank);
+    const std::vector<int>& own = in_primes ? primes : others;
+    const std::vector<int>& other = in_primes ? others : primes;
+    // The elements of the other vector before this one, the next of them bounds the run
+    std::size_t before = rank - index;
+    auto end = before < other.size() ? std::lower_bound(own.begin() + (long)index, own.end(), other[before])
+                                     : own.end();
+    return std::span<const int>(own.data() + index, (std::size_t)(end - own.begin()) - index);
+}
+
+std::size_t PartitionedStorage::primeRank(std::size_t k) const {
+    if (k >= primes.size()) {
+        throw std::out_of_range("PartitionedStorage: prime index out of range");
+    }
+    return k + (std::size_t)(std::lower_bound(others.begin(), others.end(), primes[k]) - others.begin());
+}
+
+const int& PartitionedStorage::primeValue(std::size_t k) const {
+    if (k >= primes.size()) {
+        throw std::out_of_range("PartitionedStorage: prime index out of range");
+    }
+    return primes[k];
+}
+
+void PartitionedStorage::insert(int value, bool prime) {
+    std::vector<int>& target = prime ? primes : others;
+    target.insert(std::lower_bound(target.begin(), target.end(), value), value);
+}
+
+bool PartitionedStorage::erase(int value) {
+    for (std::vector<int>* source : {&primes, &others}) {
+        auto it = std::lower_bound(source->begin(), source->end(), value);
+        if (it != source->end() && *it == value) {
+            source->erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PartitionedStorage::exportTo(std::vector<int>& values, PrimeBitmap& prime_bits) const {
+    values.clear();
+    prime_bits.clear();
+    values.reserve(size());
+    prime_bits.reserve(size());
+    std::size_t next_prime = 0;
+    std::size_t next_other = 0;
+    while (next_prime < primes.size() || next_other < others.size()) {
+        bool prime = next_other == others.size() ||
+                     (next_prime < primes.size() && primes[next_prime] < others[next_other]);
+        values.push_back(prime ? primes[next_prime++] : others[next_other++]);
+        prime_bits.push_back(prime);
+    }
+}
+
+void PartitionedStorage::assign(const std::vector<int>& values, const PrimeBitmap& prime_bits) {
+    primes.clear();
+    others.clear();
+    primes.reserve(prime_bits.count());
+    others.reserve(values.size() - prime_bits.count());
+    for (std::size_t i = 0; i < values.size(); i++) {
+        (prime_bits.test(i) ? primes : others).push_back(values[i]);
+    }
+}
+
+std::unique_ptr<OrderedStorage> PartitionedStorage::clone() const {
+    auto other = std::make_unique<PartitionedStorage>();
+    other->primes = primes;
+    other->others = others;
+    return other;
+}
@@ -0,0 +1,91 @@
+//
+// Created by super on 6/24/23.
+//
+
+#ifndef MAGICAL_ITERATORS_PARTITIONEDSTORAGE_H
+#define MAGICAL_ITERATORS_PARTITIONEDSTORAGE_H
+#include <utility>
+#include "OrderedStorage.hpp"
+
+namespace ariel{
+    /**
+     * @brief PartitionedStorage class - the primes and the other elements in two separate sorted vectors
+     * The prime order is the primes vector itself, so primeValue() is a plain load and a prime traversal streams
+     * one array. The ascending order is the merge of the two vectors: an element's rank is its index in its own
+     * vector plus the number of smaller elements in the other one, found by binary search. Equal elements are
+     * always in the same vector, since they are either all prime or all not.
+     * Inserts and removes shift only the vector the element belongs to, and never touch a prime index.
+     */
+    class PartitionedStorage : public OrderedStorage {
+        std::vector<int> primes;
+        std::vector<int> others;
+
+        /**
+         * @brief Finds the element with the given rank in the merged order
+         * @return std::pair<bool, std::size_t> - whether it is in primes, and its index in that vector
+         * @complexity O(log(n))
+         */
+        std::pair<bool, std::size_t> locate(std::size_t rank) const;
+
+    public:
+        PartitionedStorage() = default;
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t size() const override;
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t primeCount() const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        const int& at(std::size_t rank) const override;
+
+        /**
+         * @brief The run ends where the next element of the merged order comes from the other vector
+         * @complexity O(log(n))
+         */
+        std::span<const int> runAt(std::size_t rank) const override;
+
+        /**
+         * @complexity O(log(n))
+         */
+        std::size_t primeRank(std::size_t k) const override;
+
+        /**
+         * @complexity O(1)
+         */
+        const int& primeValue(std::size_t k) const override;
+
+        /**
+         * @complexity O(the size of the vector the element goes into)
+         */
+        void insert(int value, bool prime) override;
+
+        /**
+         * @complexity O(the size of the vector the element is in)
+         */
+        bool erase(int value) override;
+
+        /**
+         * @complexity O(n)
+         */
+        void exportTo(std::vector<int>& values, PrimeBitmap& primes) const override;
+
+        /**
+         * @complexity O(n)
+         */
+        void assign(const std::vector<int>& values, const PrimeBitmap& primes) override;
+
+        /**
+         * @complexity O(n)
+         */
+        std::unique_ptr<OrderedStorage> clone() const override;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_PARTITIONEDSTORAGE_H
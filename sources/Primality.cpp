@@ -0,0 +1,131 @@
+//
+// Created by super on 6/14/23.
+//
+
+#include "Primality.hpp"
+#include <cstdint>
+
+namespace {
+    const uint32_t SMALL_PRIMES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+
+    /**
+     * Every composite below 67 * 67 has a factor in SMALL_PRIMES
+     */
+    const uint32_t SMALL_PRIMES_LIMIT = 67 * 67;
+
+    /**
+     * Testing these three bases is exact for every n < 4,759,123,141
+     */
+    const uint32_t WITNESSES[] = {2, 7, 61};
+
+    /**
+     * Montgomery arithmetic modulo an odd n < 2^31, with R = 2^32.
+     * n < 2^31 keeps T + m * n below 2^64 in reduce, so no carry has to be tracked
+     */
+    class Montgomery {
+        uint32_t n;
+        uint32_t n_neg_inv; // -n^-1 mod 2^32
+        uint32_t r2;        // R^2 mod n
+
+    public:
+        explicit Montgomery(uint32_t mod): n(mod), n_neg_inv(0), r2(0) {
+            uint32_t inv = mod; // correct to 3 bits, every Newton step doubles that
+            for (int i = 0; i < 4; i++) {
+                inv *= 2 - mod * inv;
+            }
+            n_neg_inv = 0 - inv;
+            r2 = (uint32_t)((0 - (uint64_t)mod) % mod); // 2^64 mod n
+        }
+
+        uint32_t reduce(uint64_t value) const {
+            uint32_t factor = (uint32_t)value * n_neg_inv;
+            uint32_t result = (uint32_t)((value + (uint64_t)factor * n) >> 32);
+            return result >= n ? result - n : result;
+        }
+
+        uint32_t to(uint32_t value) const {
+            return reduce((uint64_t)value * r2);
+        }
+
+        uint32_t mul(uint32_t lhs, uint32_t rhs) const {
+            return reduce((uint64_t)lhs * rhs);
+        }
+
+        uint32_t pow(uint32_t base, uint32_t exp) const {
+            uint32_t result = to(1);
+            while (exp > 0) {
+                if (exp & 1U) {
+                    result = mul(result, base);
+                }
+                base = mul(base, base);
+                exp >>= 1U;
+            }
+            return result;
+        }
+    };
+
+    /**
+     * @brief One Miller-Rabin round
+     * @return true if n is a strong probable prime to the given base
+     */
+    bool strongProbablePrime(const Montgomery& mont, uint32_t num, uint32_t base, uint32_t odd, int twos) {
+        base %= num;
+        if (base == 0) {
+            return true;
+        }
+        uint32_t one = mont.to(1);
+        uint32_t minus_one = mont.to(num - 1);
+        uint32_t x = mont.pow(mont.to(base), odd);
+        if (x == one || x == minus_one) {
+            return true;
+        }
+        for (int i = 1; i < twos; i++) {
+            x = mont.mul(x, x);
+            if (x == minus_one) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+bool ariel::isPrime(int num) {
+    if (num < 2) {
+        return false;
+    }
+    auto n = (uint32_t)num;
+    for (uint32_t prime : SMALL_PRIMES) {
+        if (n % prime == 0) {
+            return n == prime;
+        }
+    }
+    if (n < SMALL_PRIMES_LIMIT) {
+        return true;
+    }
+
+    uint32_t odd = n - 1;
+    int twos = 0;
+    while ((odd & 1U) == 0) {
+        odd >>= 1U;
+        twos++;
+    }
+    Montgomery mont(n);
+    for (uint32_t base : WITNESSES) {
+        if (!strongProbablePrime(mont, n, base, odd, twos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ariel::isPrimeTrialDivision(int num) {
+    if (num < 2) {
+        return false;
+    }
+    for (int i = 2; (long)i * i <= num; i++) {
+        if (num % i == 0) {
+            return false;
+        }
+    }
+    return true;
+}
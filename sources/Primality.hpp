@@ -0,0 +1,35 @@
+//
+// Created by super on 6/14/23.
+//
+
+#ifndef MAGICAL_ITERATORS_PRIMALITY_H
+#define MAGICAL_ITERATORS_PRIMALITY_H
+
+namespace ariel{
+    /**
+     * A primality test that the MagicalContainer uses to classify its elements.
+     * Any function with this signature can be plugged into a container (see MagicalContainer(PrimeTest))
+     */
+    typedef bool (*PrimeTest)(int);
+
+    /**
+     * @brief The default primality test.
+     * Numbers below 4489 are answered by trial division with the primes up to 61, bigger numbers run a
+     * deterministic Miller-Rabin with the bases 2, 7 and 61 (exact for every n < 4,759,123,141, so for every int),
+     * using Montgomery multiplication for the modular exponentiation.
+     * @param num The number to test
+     * @return true if num is prime, false otherwise
+     * @complexity O(log(num))
+     */
+    bool isPrime(int num);
+
+    /**
+     * @brief The plain trial division test, kept as a reference engine
+     * @param num The number to test
+     * @return true if num is prime, false otherwise
+     * @complexity O(sqrt(num))
+     */
+    bool isPrimeTrialDivision(int num);
+}
+
+#endif //MAGICAL_ITERATORS_PRIMALITY_H
@@ -0,0 +1,202 @@
+//
+// Created by super on 6/20/23.
+//
+
+#include "PrimeBitmap.hpp"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+using namespace ariel;
+
+namespace {
+    /**
+     * @return uint64_t - a mask of the bits below pos
+     */
+    uint64_t bitsBelow(std::size_t pos) {
+        return ((uint64_t)1 << pos) - 1;
+    }
+
+    /**
+     * @return std::size_t - the position of the k'th set bit of word
+     */
+    std::size_t selectInWord(uint64_t word, std::size_t k) {
+        std::size_t pos = 0;
+        for (std::size_t width = 32; width >= 8; width /= 2) {
+            auto low = (std::size_t)std::popcount(word & bitsBelow(width));
+            if (k >= low) {
+                k -= low;
+                word >>= width;
+                pos += width;
+            }
+        }
+        for (std::size_t i = 0; i < k; i++) {
+            word &= word - 1;
+        }
+        return pos + (std::size_t)std::countr_zero(word);
+    }
+}
+
+PrimeBitmap::PrimeBitmap(): bit_count(0), one_count(0), directory_valid(0) {}
+
+void PrimeBitmap::refreshDirectory() const {
+    if (directoryUpToDate()) {
+        return;
+    }
+    std::size_t blocks = (words.size() + WORDS_PER_BLOCK - 1) / WORDS_PER_BLOCK;
+    directory.resize(blocks);
+    if (directory_valid == 0 && blocks > 0) {
+        directory[0] = 0;
+        directory_valid = 1;
+    }
+    for (std::size_t j = directory_valid; j < blocks; j++) {
+        uint32_t ones = directory[j - 1];
+        for (std::size_t w = (j - 1) * WORDS_PER_BLOCK; w < j * WORDS_PER_BLOCK; w++) {
+            ones += (uint32_t)std::popcount(words[w]);
+        }
+        directory[j] = ones;
+    }
+    directory_valid = blocks;
+}
+
+void PrimeBitmap::push_back(bool bit) {
+    if (bit_count % 64 == 0) {
+        words.push_back(0);
+    }
+    if (bit) {
+        words[bit_count / 64] |= (uint64_t)1 << (bit_count % 64);
+        one_count++;
+        invalidate(bit_count / 64);
+    }
+    bit_count++;
+}
+
+void PrimeBitmap::insert(std::size_t pos, bool bit) {
+    if (pos > bit_count) {
+        throw std::out_of_range("PrimeBitmap: position out of range");
+    }
+    if (bit_count % 64 == 0) {
+        words.push_back(0);
+    }
+    std::size_t word = pos / 64;
+    // Going down, every word takes the top bit of the word below it before that word is shifted
+    for (std::size_t i = words.size() - 1; i > word; i--) {
+        words[i] = (words[i] << 1U) | (words[i - 1] >> 63U);
+    }
+    uint64_t low = words[word] & bitsBelow(pos % 64);
+    uint64_t high = words[word] & ~bitsBelow(pos % 64);
+    words[word] = low | (high << 1U) | ((uint64_t)bit << (pos % 64));
+    bit_count++;
+    one_count += bit ? 1 : 0;
+    invalidate(word);
+}
+
+bool PrimeBitmap::erase(std::size_t pos) {
+    if (pos >= bit_count) {
+        throw std::out_of_range("PrimeBitmap: position out of range");
+    }
+    bool bit = test(pos);
+    std::size_t word = pos / 64;
+    words[word] = (words[word] & bitsBelow(pos % 64)) | ((words[word] >> 1U) & ~bitsBelow(pos % 64));
+    for (std::size_t i = word + 1; i < words.size(); i++) {
+        words[i - 1] |= (words[i] & 1U) << 63U;
+        words[i] >>= 1U;
+    }
+    bit_count--;
+    if (bit_count % 64 == 0) {
+        words.pop_back();
+    }
+    one_count -= bit ? 1 : 0;
+    invalidate(word);
+    return bit;
+}
+
+void PrimeBitmap::truncate(std::size_t bits) {
+    if (bits >= bit_count) {
+        return;
+    }
+    std::size_t kept_words = (bits + 63) / 64;
+    for (std::size_t i = kept_words; i < words.size(); i++) {
+        one_count -= (std::size_t)std::popcount(words[i]);
+    }
+    words.resize(kept_words);
+    if (bits % 64 != 0) {
+        uint64_t dropped = words.back() & ~bitsBelow(bits % 64);
+        one_count -= (std::size_t)std::popcount(dropped);
+        words.back() &= bitsBelow(bits % 64);
+    }
+    bit_count = bits;
+    invalidate(bits / 64);
+}
+
+void PrimeBitmap::clear() {
+    words.clear();
+    directory.clear();
+    bit_count = 0;
+    one_count = 0;
+    directory_valid = 0;
+    select_hint.packed.store(SelectHint::NO_HINT, std::memory_order_relaxed);
+}
+
+void PrimeBitmap::reserve(std::size_t bits) {
+    words.reserve((bits + 63) / 64);
+}
+
+std::size_t PrimeBitmap::rank(std::size_t pos) const {
+    if (pos >= bit_count) {
+        return one_count;
+    }
+    refreshDirectory();
+    std::size_t block = pos / 64 / WORDS_PER_BLOCK;
+    std::size_t ones = directory[block];
+    for (std::size_t w = block * WORDS_PER_BLOCK; w < pos / 64; w++) {
+        ones += (std::size_t)std::popcount(words[w]);
+    }
+    return ones + (std::size_t)std::popcount(words[pos / 64] & bitsBelow(pos % 64));
+}
+
+std::size_t PrimeBitmap::select(std::size_t k) const {
+    if (k >= one_count) {
+        throw std::out_of_range("PrimeBitmap: prime index out of range");
+    }
+    uint64_t hint = select_hint.packed.load(std::memory_order_relaxed);
+    if (hint != SelectHint::NO_HINT) {
+        std::size_t hint_k = hint >> 32U;
+        std::size_t hint_pos = hint & UINT32_MAX;
+        if (k == hint_k) {
+            return hint_pos;
+        }
+        if (k == hint_k + 1) {
+            // The next set bit after the previous answer
+            std::size_t w = (hint_pos + 1) / 64;
+            uint64_t word = (hint_pos + 1) % 64 == 0 ? words[w] : words[w] & ~bitsBelow((hint_pos + 1) % 64);
+            while (word == 0) {
+                word = words[++w];
+            }
+            std::size_t pos = w * 64 + (std::size_t)std::countr_zero(word);
+            remember(k, pos);
+            return pos;
+        }
+    }
+    refreshDirectory();
+    // The last block with at most k set bits before it holds the k'th set bit
+    auto block = (std::size_t)(std::upper_bound(directory.begin(), directory.end(), (uint32_t)k) -
+                               directory.begin()) - 1;
+    std::size_t rest = k - directory[block];
+    for (std::size_t w = block * WORDS_PER_BLOCK;; w++) {
+        auto ones = (std::size_t)std::popcount(words[w]);
+        if (rest < ones) {
+            std::size_t pos = w * 64 + selectInWord(words[w], rest);
+            remember(k, pos);
+            return pos;
+        }
+        rest -= ones;
+    }
+}
+
+std::size_t PrimeBitmap::memoryUsage() const {
+    return words.capacity() * sizeof(uint64_t) + directory.capacity() * sizeof(uint32_t);
+}
+
+bool PrimeBitmap::operator==(const PrimeBitmap& other) const {
+    return bit_count == other.bit_count && words == other.words;
+}
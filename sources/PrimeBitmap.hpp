@@ -0,0 +1,178 @@
+//
+// Created by super on 6/20/23.
+//
+
+#ifndef MAGICAL_ITERATORS_PRIMEBITMAP_H
+#define MAGICAL_ITERATORS_PRIMEBITMAP_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ariel{
+    /**
+     * @brief PrimeBitmap class - a bit vector with rank and select, marking which elements of a container are prime
+     * Bit i is set if the i'th smallest element is prime, so the bitmap takes 1 bit per element. On top of the bits
+     * there is a directory with the number of set bits before every block of 1024 bits, 32 more bits per block
+     * (about 3% overhead). select() binary searches the directory and then scans at most one block.
+     * Inserting or erasing a bit shifts the words after it by one bit and invalidates the directory from that block
+     * on. The directory is rebuilt on the next rank()/select() call, so a run of updates pays for it once.
+     * Once the directory is up to date (see refreshDirectory) the const methods only write the select hint, which is a
+     * relaxed atomic, so any number of threads can read one bitmap as long as none of them modifies it.
+     */
+    class PrimeBitmap {
+        std::vector<uint64_t> words;
+        std::size_t bit_count;
+        std::size_t one_count;
+        mutable std::vector<uint32_t> directory; // the number of set bits before every block
+        mutable std::size_t directory_valid;     // the number of leading directory entries that are up to date
+
+        /**
+         * The last select() call, so walking the primes in order doesn't need the directory. The k and the position
+         * are packed in one word (k in the high half), so a thread that reads the hint sees a whole pair, possibly
+         * another thread's. NO_HINT means there is no hint. It copies like a plain value
+         */
+        struct SelectHint {
+            static const uint64_t NO_HINT = UINT64_MAX;
+            std::atomic<uint64_t> packed;
+
+            SelectHint(): packed(NO_HINT) {}
+            SelectHint(const SelectHint& other): packed(other.packed.load(std::memory_order_relaxed)) {}
+            SelectHint& operator=(const SelectHint& other) {
+                packed.store(other.packed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return *this;
+            }
+            ~SelectHint() = default;
+        };
+        mutable SelectHint select_hint;
+
+        /**
+         * @brief Remembers the answer of a select() call, unless k or pos don't fit in half a word
+         */
+        void remember(std::size_t k, std::size_t pos) const {
+            if (k < UINT32_MAX && pos <= UINT32_MAX) {
+                select_hint.packed.store(((uint64_t)k << 32U) | pos, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief Marks the directory entries after the block of the given word, and the select hint, as out of date
+         */
+        void invalidate(std::size_t word) {
+            std::size_t keep = word / WORDS_PER_BLOCK + 1;
+            if (keep < directory_valid) {
+                directory_valid = keep;
+            }
+            select_hint.packed.store(SelectHint::NO_HINT, std::memory_order_relaxed);
+        }
+
+    public:
+        static const std::size_t WORDS_PER_BLOCK = 16;
+
+        PrimeBitmap();
+
+        /**
+         * @return std::size_t - the number of bits
+         */
+        std::size_t size() const {
+            return bit_count;
+        }
+
+        /**
+         * @return std::size_t - the number of set bits
+         */
+        std::size_t count() const {
+            return one_count;
+        }
+
+        /**
+         * @return bool - the bit at pos
+         */
+        bool test(std::size_t pos) const {
+            return ((words[pos / 64] >> (pos % 64)) & 1U) != 0;
+        }
+
+        /**
+         * @return const std::vector<uint64_t>& - the bits, 64 per word, bit i of the bitmap is bit i % 64 of word i / 64
+         */
+        const std::vector<uint64_t>& data() const {
+            return words;
+        }
+
+        /**
+         * @brief Appends a bit
+         * @complexity O(1) amortized
+         */
+        void push_back(bool bit);
+
+        /**
+         * @brief Inserts a bit at pos, moving the bits at pos and after it one position up
+         * @complexity O(n / 64)
+         */
+        void insert(std::size_t pos, bool bit);
+
+        /**
+         * @brief Erases the bit at pos, moving the bits after it one position down
+         * @return bool - the erased bit
+         * @complexity O(n / 64)
+         */
+        bool erase(std::size_t pos);
+
+        /**
+         * @brief Keeps only the first bits, dropping the rest
+         * @param bits The number of bits to keep, if it is >= size() nothing changes
+         * @complexity O(the number of dropped bits / 64)
+         */
+        void truncate(std::size_t bits);
+
+        /**
+         * @brief Removes all the bits
+         */
+        void clear();
+
+        /**
+         * @brief Reserves room for the given number of bits
+         */
+        void reserve(std::size_t bits);
+
+        /**
+         * @return std::size_t - the number of set bits before pos
+         * @complexity O(1) once the directory is up to date
+         */
+        std::size_t rank(std::size_t pos) const;
+
+        /**
+         * @return std::size_t - the position of the k'th set bit
+         * @throws out_of_range if k >= count()
+         * @complexity O(log(n)) once the directory is up to date, O(1) amortized when k is the previous call's k + 1
+         */
+        std::size_t select(std::size_t k) const;
+
+        /**
+         * @brief Brings the whole directory up to date. rank() and select() call it on their own, calling it after a
+         * run of updates lets other threads read the bitmap without writing to the directory
+         * @complexity O(the number of words after the first out of date entry), O(1) when it is up to date
+         */
+        void refreshDirectory() const;
+
+        /**
+         * @return true if the directory is up to date, so refreshDirectory() has nothing to do
+         */
+        bool directoryUpToDate() const {
+            std::size_t blocks = (words.size() + WORDS_PER_BLOCK - 1) / WORDS_PER_BLOCK;
+            return directory_valid == blocks && directory.size() == blocks;
+        }
+
+        /**
+         * @return std::size_t - the number of bytes the bits and the directory take
+         */
+        std::size_t memoryUsage() const;
+
+        /**
+         * @return true if both bitmaps hold the same bits
+         */
+        bool operator==(const PrimeBitmap& other) const;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_PRIMEBITMAP_H
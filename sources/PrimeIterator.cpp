@@ -6,66 +6,142 @@
 using namespace ariel;
 
 typedef std::vector<int>::size_type size_type;
-typedef MagicalContainer::PrimeIterator PrimeIterator;
 
-PrimeIterator::PrimeIterator(MagicalContainer& container): _container(container), current_index(0) {}
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::BasicPrimeIterator(): _container(nullptr), current_index(0) {}
 
-PrimeIterator::PrimeIterator(MagicalContainer& container, int index): _container(container){
-    if(index < 0 || index > container.p_size()){
-        throw std::out_of_range("PrimeIterator: iterator out of range");
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::BasicPrimeIterator(MagicalContainer& container)
+: _container(&container), current_index(0) {}
+
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::BasicPrimeIterator(const MagicalContainer& container, int index)
+: _container(&container) {
+    if constexpr (Checks::checks) {
+        if(index < 0 || index > container.p_size()){
+            throw std::out_of_range("PrimeIterator: iterator out of range");
+        }
     }
     current_index = index;
 }
 
-PrimeIterator::PrimeIterator(const PrimeIterator& other): _container(other._container), current_index(other.current_index) {}
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::BasicPrimeIterator(const BasicPrimeIterator& other)
+: _container(other._container), current_index(other.current_index) {}
 
-PrimeIterator PrimeIterator::begin() {
-    return PrimeIterator(_container, 0);
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks> MagicalContainer::BasicPrimeIterator<Checks>::begin() {
+    return BasicPrimeIterator(*_container, 0);
 }
 
-PrimeIterator PrimeIterator::end() {
-    return PrimeIterator(_container, _container.p_size());
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks> MagicalContainer::BasicPrimeIterator<Checks>::end() {
+    return BasicPrimeIterator(*_container, _container->p_size());
 }
 
-int PrimeIterator::operator*() const {
-    if (current_index < _container.p_size()) {
-        return _container.at((size_type)_container.p_at((size_type)current_index));
-    }
-    throw std::out_of_range("PrimeIterator: iterator out of range");
+template<typename Checks>
+bool MagicalContainer::BasicPrimeIterator<Checks>::operator<(const BasicPrimeIterator& other) const {
+    return current_index < other.current_index;
 }
 
-bool PrimeIterator::operator==(const PrimeIterator &other) const {
-    return current_index == other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicPrimeIterator<Checks>::operator>(const BasicPrimeIterator& other) const {
+    return current_index > other.current_index;
 }
 
-bool PrimeIterator::operator!=(const PrimeIterator &other) const {
-    return !(*this == other);
+template<typename Checks>
+bool MagicalContainer::BasicPrimeIterator<Checks>::operator<=(const BasicPrimeIterator& other) const {
+    return current_index <= other.current_index;
 }
 
-bool PrimeIterator::operator<(const PrimeIterator& other) const {
-    return current_index < other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicPrimeIterator<Checks>::operator>=(const BasicPrimeIterator& other) const {
+    return current_index >= other.current_index;
+}
+
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks> MagicalContainer::BasicPrimeIterator<Checks>::operator++(int){
+    BasicPrimeIterator temp = BasicPrimeIterator(*this);
+    ++(*this);
+    return temp;
 }
 
-bool PrimeIterator::operator>(const PrimeIterator& other) const {
-    return (current_index > other.current_index) && (*this != other);
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>& MagicalContainer::BasicPrimeIterator<Checks>::operator--(){
+    if constexpr (Checks::checks) {
+        if(current_index <= 0){
+            throw std::runtime_error("PrimeIterator: iterator out of range");
+        }
+    }
+    current_index--;
+    return *this;
 }
 
-const PrimeIterator PrimeIterator::operator++(int) {
-    const PrimeIterator temp = PrimeIterator(*this);
-    current_index++;
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks> MagicalContainer::BasicPrimeIterator<Checks>::operator--(int){
+    BasicPrimeIterator temp = BasicPrimeIterator(*this);
+    --(*this);
     return temp;
 }
 
-PrimeIterator& PrimeIterator::operator++() {
-    if(current_index >= _container.p_size()){
-        throw std::runtime_error("SideCrossIterator: iterator out of range");
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>&
+MagicalContainer::BasicPrimeIterator<Checks>::operator+=(difference_type steps) {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target > _container->p_size()){
+            throw std::out_of_range("PrimeIterator: iterator out of range");
+        }
     }
-    current_index++;
+    current_index = (int)target;
     return *this;
 }
 
-PrimeIterator& PrimeIterator::operator=(const PrimeIterator& other) {
-    if(this->_container != other._container)
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>&
+MagicalContainer::BasicPrimeIterator<Checks>::operator-=(difference_type steps) {
+    return *this += -steps;
+}
+
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::operator+(difference_type steps) const {
+    BasicPrimeIterator moved(*this);
+    moved += steps;
+    return moved;
+}
+
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>
+MagicalContainer::BasicPrimeIterator<Checks>::operator-(difference_type steps) const {
+    BasicPrimeIterator moved(*this);
+    moved -= steps;
+    return moved;
+}
+
+template<typename Checks>
+std::ptrdiff_t MagicalContainer::BasicPrimeIterator<Checks>::operator-(const BasicPrimeIterator& other) const {
+    return current_index - other.current_index;
+}
+
+template<typename Checks>
+const int& MagicalContainer::BasicPrimeIterator<Checks>::operator[](difference_type steps) const {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target >= _container->p_size()){
+            throw std::out_of_range("PrimeIterator: iterator out of range");
+        }
+        return _container->p_value((size_type)target);
+    }
+    else {
+        return _container->primeUnchecked((size_type)target);
+    }
+}
+
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>&
+MagicalContainer::BasicPrimeIterator<Checks>::operator=(const BasicPrimeIterator& other) {
+    if(_container != nullptr && _container != other._container)
         throw std::runtime_error("PrimeIterator: iterators are not from the same container");
     if (this != &other) {
         _container = other._container;
@@ -74,6 +150,11 @@ PrimeIterator& PrimeIterator::operator=(const PrimeIterator& other) {
     return *this;
 }
 
+template<typename Checks>
+MagicalContainer::BasicPrimeIterator<Checks>&
+MagicalContainer::BasicPrimeIterator<Checks>::operator=(BasicPrimeIterator&& other) {
+    return *this = other;
+}
 
-
-
+template class MagicalContainer::BasicPrimeIterator<Checked>;
+template class MagicalContainer::BasicPrimeIterator<Unchecked>;
@@ -0,0 +1,279 @@
+//
+// Created by super on 6/28/23.
+//
+
+#include "ShardedMagicalContainer.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+using namespace ariel;
+
+typedef std::vector<int>::size_type size_type;
+typedef ShardedMagicalContainer::ReadGuard ReadGuard;
+
+ShardedMagicalContainer::Shard::Shard(int low, PrimeTest prime_test): low(low), elements(prime_test), count(0) {}
+
+void ShardedMagicalContainer::Shard::written() {
+    elements.prepareReads();
+    count.store((size_type)elements.size(), std::memory_order_relaxed);
+}
+
+ShardedMagicalContainer::ShardedMagicalContainer(size_type initial_shards, size_type shard_size, PrimeTest prime_test)
+: min_shards(initial_shards), shard_size(shard_size), prime_test(prime_test) {
+    if(initial_shards == 0 || shard_size == 0){
+        throw std::invalid_argument("ShardedMagicalContainer: the number of shards and their size must be positive");
+    }
+    if(prime_test == nullptr){
+        throw std::invalid_argument("ShardedMagicalContainer: prime test must not be null");
+    }
+    // Even slices of the 2^32 ints, so the first shard starts at INT_MIN
+    for (size_type i = 0; i < initial_shards; i++) {
+        int64_t low = (int64_t)INT_MIN + (int64_t)(((uint64_t)1 << 32U) * i / initial_shards);
+        shards.push_back(std::make_unique<Shard>((int)low, prime_test));
+    }
+}
+
+size_type ShardedMagicalContainer::shardOf(int value) const {
+    auto it = std::upper_bound(shards.begin(), shards.end(), value, [](int val, const std::unique_ptr<Shard>& shard) {
+        return val < shard->low;
+    });
+    return (size_type)(it - shards.begin()) - 1;
+}
+
+bool ShardedMagicalContainer::splittable(const Shard& shard) const {
+    auto count = (size_type)shard.elements.size();
+    return count > 2 * shard_size && shard.elements.at(0) != shard.elements.at(count - 1);
+}
+
+size_type ShardedMagicalContainer::mergePartner(size_type index) const {
+    size_type count = shards[index]->count.load(std::memory_order_relaxed);
+    if(shards.size() <= min_shards || count >= shard_size / 8){
+        return shards.size();
+    }
+    size_type partner = shards.size();
+    size_type partner_count = 0;
+    for (size_type neighbour : {index - 1, index + 1}) {
+        // index - 1 wraps around for the first shard
+        if(neighbour < shards.size()){
+            size_type neighbour_count = shards[neighbour]->count.load(std::memory_order_relaxed);
+            if(partner == shards.size() || neighbour_count < partner_count){
+                partner = neighbour;
+                partner_count = neighbour_count;
+            }
+        }
+    }
+    // A merge that the split rule would undo right away is no better than the small shard
+    return count + partner_count <= 2 * shard_size ? partner : shards.size();
+}
+
+bool ShardedMagicalContainer::skewed(size_type index) const {
+    return splittable(*shards[index]) || mergePartner(index) != shards.size();
+}
+
+bool ShardedMagicalContainer::rebalanceDue(size_type index) const {
+    if(skewed(index)){
+        return true;
+    }
+    for (size_type neighbour : {index - 1, index + 1}) {
+        if(neighbour < shards.size() && mergePartner(neighbour) != shards.size()){
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShardedMagicalContainer::tryRebalance() {
+    std::unique_lock<std::shared_mutex> lock(layout, std::try_to_lock);
+    if(lock.owns_lock()){
+        rebalanceLocked();
+    }
+}
+
+void ShardedMagicalContainer::rebalance() {
+    std::unique_lock<std::shared_mutex> lock(layout);
+    rebalanceLocked();
+}
+
+void ShardedMagicalContainer::rebalanceLocked() {
+    // A split leaves two smaller shards and a merge never leaves a splittable one, so the passes settle
+    for (size_type i = 0; i < shards.size();) {
+        Shard& shard = *shards[i];
+        if(splittable(shard)){
+            // Split at the median, moved up past its duplicates when they start the shard, so equal values stay
+            // in one shard. The shard has two distinct values, so one of the bounds is inside it
+            auto ascending = shard.elements.ascending();
+            int split = shard.elements.at((size_type)shard.elements.size() / 2);
+            auto first_moved = std::ranges::lower_bound(ascending, split);
+            if(first_moved == ascending.begin()){
+                first_moved = std::ranges::upper_bound(ascending, split);
+            }
+            split = *first_moved;
+            vector<int> moved;
+            std::ranges::copy(first_moved, ascending.end(), std::back_inserter(moved));
+            auto upper = std::make_unique<Shard>(split, prime_test);
+            upper->elements.addElements(std::span<const int>(moved));
+            upper->written();
+            shard.elements.erase_if([split](int elm) { return elm >= split; });
+            shard.written();
+            shards.insert(shards.begin() + (long)i + 1, std::move(upper));
+            continue;
+        }
+        size_type partner = mergePartner(i);
+        if(partner != shards.size()){
+            // The lower of the two keeps its low bound and takes the upper one's elements
+            i = std::min(i, partner);
+            Shard& lower = *shards[i];
+            vector<int> moved;
+            std::ranges::copy(shards[i + 1]->elements.ascending(), std::back_inserter(moved));
+            lower.elements.addElements(std::span<const int>(moved));
+            lower.written();
+            shards.erase(shards.begin() + (long)i + 1);
+            continue;
+        }
+        i++;
+    }
+}
+
+bool ShardedMagicalContainer::balanced() const {
+    std::shared_lock<std::shared_mutex> lock(layout);
+    for (size_type i = 0; i < shards.size(); i++) {
+        std::shared_lock<std::shared_mutex> shard_lock(shards[i]->mutex);
+        if(skewed(i)){
+            return false;
+        }
+    }
+    return true;
+}
+
+ReadGuard::ReadGuard(const ShardedMagicalContainer& container)
+: layout_lock(container.layout), shards(&container.shards) {
+    shard_locks.reserve(shards->size());
+    starts.push_back(0);
+    prime_starts.push_back(0);
+    // The writers lock one shard only, so taking them in order can't deadlock
+    for (const auto& shard : *shards) {
+        shard_locks.emplace_back(shard->mutex);
+        starts.push_back(starts.back() + (size_type)shard->elements.size());
+        prime_starts.push_back(prime_starts.back() + (size_type)shard->elements.p_size());
+    }
+}
+
+const int& ReadGuard::at(size_type rank) const {
+    if(rank >= starts.back()){
+        throw std::out_of_range("ShardedMagicalContainer: rank out of range");
+    }
+    auto shard = (size_type)(std::upper_bound(starts.begin(), starts.end(), rank) - starts.begin()) - 1;
+    return (*shards)[shard]->elements.at(rank - starts[shard]);
+}
+
+const int& ReadGuard::p_value(size_type k) const {
+    if(k >= prime_starts.back()){
+        throw std::out_of_range("ShardedMagicalContainer: prime index out of range");
+    }
+    auto shard = (size_type)(std::upper_bound(prime_starts.begin(), prime_starts.end(), k) - prime_starts.begin()) - 1;
+    return (*shards)[shard]->elements.p_value(k - prime_starts[shard]);
+}
+
+ReadGuard ShardedMagicalContainer::read() const {
+    return ReadGuard(*this);
+}
+
+size_type ShardedMagicalContainer::shardCount() const {
+    std::shared_lock<std::shared_mutex> lock(layout);
+    return shards.size();
+}
+
+int ShardedMagicalContainer::size() const {
+    std::shared_lock<std::shared_mutex> lock(layout);
+    int count = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> shard_lock(shard->mutex);
+        count += shard->elements.size();
+    }
+    return count;
+}
+
+void ShardedMagicalContainer::addElement(int elm) {
+    bool skew = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(layout);
+        size_type index = shardOf(elm);
+        Shard& shard = *shards[index];
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        shard.elements.addElement(elm);
+        shard.written();
+        skew = rebalanceDue(index);
+    }
+    if(skew){
+        tryRebalance();
+    }
+}
+
+int ShardedMagicalContainer::tryRemoveElement(int elm) {
+    bool skew = false;
+    int removed = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(layout);
+        size_type index = shardOf(elm);
+        Shard& shard = *shards[index];
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        removed = shard.elements.tryRemoveElement(elm);
+        shard.written();
+        skew = rebalanceDue(index);
+    }
+    if(skew){
+        tryRebalance();
+    }
+    return removed;
+}
+
+int ShardedMagicalContainer::removeElement(int elm) {
+    if(tryRemoveElement(elm) == 0){
+        throw std::runtime_error("Element not found");
+    }
+    return 1;
+}
+
+template<typename F>
+bool ShardedMagicalContainer::forEachRun(std::span<const int> batch, F apply) {
+    std::shared_lock<std::shared_mutex> lock(layout);
+    bool skew = false;
+    // The sorted batch falls into the shards in order, one run per shard
+    for (size_type first = 0; first < batch.size();) {
+        size_type index = shardOf(batch[first]);
+        size_type last = batch.size();
+        if(index + 1 < shards.size()){
+            last = (size_type)(std::lower_bound(batch.begin() + (long)first, batch.end(), shards[index + 1]->low)
+                               - batch.begin());
+        }
+        Shard& shard = *shards[index];
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        apply(shard.elements, batch.subspan(first, last - first));
+        shard.written();
+        skew = skew || rebalanceDue(index);
+        first = last;
+    }
+    return skew;
+}
+
+void ShardedMagicalContainer::addElements(std::span<const int> elms) {
+    vector<int> batch(elms.begin(), elms.end());
+    std::sort(batch.begin(), batch.end());
+    if(forEachRun(batch, [](MagicalContainer& elements, std::span<const int> run) { elements.addElements(run); })){
+        tryRebalance();
+    }
+}
+
+int ShardedMagicalContainer::removeElements(std::span<const int> elms) {
+    vector<int> batch(elms.begin(), elms.end());
+    std::sort(batch.begin(), batch.end());
+    int removed = 0;
+    if(forEachRun(batch, [&removed](MagicalContainer& elements, std::span<const int> run) {
+        removed += elements.removeElements(run);
+    })){
+        tryRebalance();
+    }
+    return removed;
+}
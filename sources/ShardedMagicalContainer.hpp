@@ -0,0 +1,363 @@
+//
+// Created by super on 6/28/23.
+//
+
+#ifndef MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_H
+#define MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_H
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+#include "MagicalContainer.hpp"
+
+namespace ariel{
+    /**
+     * @brief ShardedMagicalContainer class - the value space split into ranges, each kept in its own MagicalContainer
+     * with its own lock, so writers of different ranges never wait for each other
+     * Shard i holds the values from its low bound up to the next shard's low bound. A write locks the shard of its
+     * value only (plus the layout lock shared), a ReadGuard locks every shard shared, and walks them in order: the
+     * ascending and prime orders are the shards' orders one after the other, and the cross order maps every cross
+     * position to a global rank and the rank to a shard through the per-shard counts.
+     * A shard that grows past twice shard_size is split at its median, unless all its elements are equal, and a shard
+     * that shrinks below an eighth of shard_size is merged into its smaller neighbour, unless the two together would
+     * be split again (never below the initial number of shards). Rebalancing takes the layout lock exclusively; a
+     * write that finds its shard skewed only tries to take it, so writers never block on each other for it, and a
+     * shard is skewed only while a split or a merge is possible, so a shard rebalancing can't fix doesn't make every
+     * write to it try again.
+     */
+    class ShardedMagicalContainer {
+        struct Shard {
+            int low; // the smallest value the shard may hold
+            MagicalContainer elements;
+            mutable std::shared_mutex mutex;
+            std::atomic<size_type> count; // elements.size(), for the writers of the neighbours, who don't lock it
+
+            Shard(int low, PrimeTest prime_test);
+
+            /**
+             * @brief Prepares the elements for shared reads and records their count, after a write. The caller holds
+             * the lock
+             */
+            void written();
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards; // ordered by low, the first one's low is INT_MIN
+        mutable std::shared_mutex layout;           // shared by every operation, exclusive while rebalancing
+        size_type min_shards;
+        size_type shard_size;
+        PrimeTest prime_test;
+
+        /**
+         * @return size_type - the index of the shard that holds value. The caller holds layout
+         * @complexity O(log(the number of shards))
+         */
+        size_type shardOf(int value) const;
+
+        /**
+         * @return true if the shard is over twice shard_size and has two distinct values to split between. The
+         * caller holds its lock
+         */
+        bool splittable(const Shard& shard) const;
+
+        /**
+         * @brief Finds the neighbour to merge a shard under an eighth of shard_size into: the smaller one, if the two
+         * together are at most twice shard_size. The caller holds layout
+         * @return size_type - the neighbour's index, or the number of shards if the shard should stay as it is
+         */
+        size_type mergePartner(size_type index) const;
+
+        /**
+         * @return true if the shard should be split or merged with a neighbour. The caller holds layout and its lock
+         */
+        bool skewed(size_type index) const;
+
+        /**
+         * @return true if a write to the shard left it skewed, or made a neighbour small enough to merge into it. The
+         * caller holds layout and the shard's lock
+         */
+        bool rebalanceDue(size_type index) const;
+
+        /**
+         * @brief Splits a sorted batch into the runs that fall in one shard each, and applies f to every shard and
+         * its run under the shard's lock. A short run costs the shard single-element writes, not a copy of the shard
+         * (see MagicalContainer::smallBatch)
+         * @param apply Called as apply(MagicalContainer&, std::span<const int>)
+         * @return bool - true if a shard was left skewed
+         */
+        template<typename F>
+        bool forEachRun(std::span<const int> batch, F apply);
+
+        /**
+         * @brief Rebalances if no other thread holds the layout lock, otherwise leaves it to a later write
+         */
+        void tryRebalance();
+
+        /**
+         * @brief Splits and merges the shards until none is skewed. The caller holds layout exclusively
+         * @complexity O(n)
+         */
+        void rebalanceLocked();
+
+    public:
+        /**
+         * @brief ReadGuard class - a consistent read of every shard
+         * The guard holds the layout lock and every shard's lock shared, from read() until it is destroyed, and
+         * keeps the rank of the first element and of the first prime of every shard
+         */
+        class ReadGuard {
+            std::shared_lock<std::shared_mutex> layout_lock;
+            std::vector<std::shared_lock<std::shared_mutex>> shard_locks;
+            const std::vector<std::unique_ptr<Shard>>* shards;
+            std::vector<size_type> starts;       // the global rank of the first element of every shard, and the size
+            std::vector<size_type> prime_starts; // the same for the primes
+
+            explicit ReadGuard(const ShardedMagicalContainer& container);
+            friend class ShardedMagicalContainer;
+
+        public:
+            /**
+             * @brief Iterator class - a forward iterator over all the shards in one of the three orders
+             * In ascending and prime order it keeps a shard and a position in it, and moves to the next shard at the
+             * end of one, O(1) per step. In cross order it keeps the cross position, and every dereference finds the
+             * shard of the global rank, O(log(the number of shards))
+             */
+            template<Order order>
+            class Iterator {
+                const ReadGuard* guard;
+                size_type shard;
+                size_type index;    // the element, or the prime, within the shard
+                size_type position; // the position in the walk
+
+                /**
+                 * @brief Moves past the shards that have nothing left in this order
+                 */
+                void skipEmpty() {
+                    if constexpr (order != Order::SideCross) {
+                        while (shard < guard->shards->size() && index == guard->count(shard, order)) {
+                            shard++;
+                            index = 0;
+                        }
+                    }
+                }
+
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef int value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const int* pointer;
+                typedef const int& reference;
+
+                Iterator(): guard(nullptr), shard(0), index(0), position(0) {}
+
+                /**
+                 * @param guard The guard to walk
+                 * @param end true for the end of the walk, false for its beginning
+                 */
+                Iterator(const ReadGuard* guard, bool end)
+                : guard(guard), shard(end ? guard->shards->size() : 0), index(0),
+                  position(end ? guard->total(order) : 0) {
+                    skipEmpty();
+                }
+
+                const int& operator*() const {
+                    if constexpr (order == Order::Ascending) {
+                        return (*guard->shards)[shard]->elements.at(index);
+                    }
+                    else if constexpr (order == Order::Prime) {
+                        return (*guard->shards)[shard]->elements.p_value(index);
+                    }
+                    else {
+                        size_type count = guard->total(order);
+                        return guard->at((position % 2 == 0) ? position / 2 : count - 1 - position / 2);
+                    }
+                }
+
+                Iterator& operator++() {
+                    position++;
+                    if constexpr (order != Order::SideCross) {
+                        index++;
+                        skipEmpty();
+                    }
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    Iterator old = *this;
+                    ++*this;
+                    return old;
+                }
+
+                bool operator==(const Iterator& other) const {
+                    return position == other.position;
+                }
+            };
+
+            typedef std::ranges::subrange<Iterator<Order::Ascending>> AscendingView;
+            typedef std::ranges::subrange<Iterator<Order::Prime>> PrimeView;
+            typedef std::ranges::subrange<Iterator<Order::SideCross>> SideCrossView;
+
+            /**
+             * @return size_type - the number of elements (or of primes, in prime order) in the given shard
+             */
+            size_type count(size_type shard, Order order) const {
+                const std::vector<size_type>& bounds = order == Order::Prime ? prime_starts : starts;
+                return bounds[shard + 1] - bounds[shard];
+            }
+
+            /**
+             * @return size_type - the number of elements, or of primes in prime order
+             */
+            size_type total(Order order) const {
+                return order == Order::Prime ? prime_starts.back() : starts.back();
+            }
+
+            /**
+             * @return int - the number of elements in all the shards
+             */
+            int size() const {
+                return (int)starts.back();
+            }
+
+            /**
+             * @return int - the number of primes in all the shards
+             */
+            int p_size() const {
+                return (int)prime_starts.back();
+            }
+
+            /**
+             * @brief Returns the element of the given global rank
+             * @throws out_of_range if rank >= size()
+             * @complexity O(log(the number of shards)) plus the shard's at()
+             */
+            const int& at(size_type rank) const;
+
+            /**
+             * @brief Returns the k'th prime of all the shards
+             * @throws out_of_range if k >= p_size()
+             * @complexity O(log(the number of shards)) plus the shard's p_value()
+             */
+            const int& p_value(size_type k) const;
+
+            /**
+             * @brief Calls f on every element in the given order, the shards' own for_each one after the other in
+             * ascending and prime order
+             */
+            template<Order order, typename F>
+            void for_each(F&& f) const {
+                if constexpr (order == Order::SideCross) {
+                    size_type low = 0;
+                    size_type high = starts.back();
+                    while (low < high) {
+                        f(at(low++));
+                        if (low < high) {
+                            f(at(--high));
+                        }
+                    }
+                }
+                else {
+                    for (const auto& shard : *shards) {
+                        shard->elements.template for_each<order>(f);
+                    }
+                }
+            }
+
+            AscendingView ascending() const {
+                return AscendingView(Iterator<Order::Ascending>(this, false), Iterator<Order::Ascending>(this, true));
+            }
+
+            PrimeView primes() const {
+                return PrimeView(Iterator<Order::Prime>(this, false), Iterator<Order::Prime>(this, true));
+            }
+
+            SideCrossView side_cross() const {
+                return SideCrossView(Iterator<Order::SideCross>(this, false), Iterator<Order::SideCross>(this, true));
+            }
+        };
+
+        /**
+         * @brief A constructor that splits the value space evenly
+         * @param initial_shards The number of shards to start with, and the fewest that merging leaves
+         * @param shard_size The number of elements a shard is balanced around
+         * @param prime_test The test used to decide which elements are prime
+         * @throws invalid_argument if initial_shards or shard_size is 0, or prime_test is null
+         */
+        explicit ShardedMagicalContainer(size_type initial_shards = 16, size_type shard_size = 1 << 16,
+                                         PrimeTest prime_test = isPrime);
+
+        ~ShardedMagicalContainer() = default;
+        ShardedMagicalContainer(const ShardedMagicalContainer& other) = delete;
+        ShardedMagicalContainer& operator=(const ShardedMagicalContainer& other) = delete;
+        ShardedMagicalContainer(ShardedMagicalContainer&& other) = delete;
+        ShardedMagicalContainer& operator=(ShardedMagicalContainer&& other) = delete;
+
+        /**
+         * @brief Locks every shard shared for a consistent read
+         * @return ReadGuard - the guard, it must not outlive the container
+         * @complexity O(the number of shards)
+         */
+        ReadGuard read() const;
+
+        /**
+         * @return size_type - the number of shards
+         */
+        size_type shardCount() const;
+
+        /**
+         * @brief Splits and merges the shards until none is skewed, waiting for the other operations to finish
+         * @complexity O(n)
+         */
+        void rebalance();
+
+        /**
+         * @return true if no shard is skewed, so rebalancing would change nothing
+         * @complexity O(the number of shards)
+         */
+        bool balanced() const;
+
+        /**
+         * @return int - the number of elements. The shards are counted one after the other, so with concurrent
+         * writes it may be a count no ReadGuard would see; read().size() is exact
+         */
+        int size() const;
+
+        /**
+         * @brief Adds an element to its shard
+         * @complexity O(the size of the shard)
+         */
+        void addElement(int elm);
+
+        /**
+         * @brief Adds a batch of elements, merging every shard's part of it at once
+         * @complexity O(k*log(k)) for k elements, plus a merge in every shard they fall in
+         */
+        void addElements(std::span<const int> elms);
+
+        /**
+         * @brief Removes an element from its shard
+         * @throws runtime_error if the element is not in the container
+         * @complexity O(the size of the shard)
+         */
+        int removeElement(int elm);
+
+        /**
+         * @brief Removes an element from its shard, without throwing when it is missing
+         * @return int - the number of elements removed
+         * @complexity O(the size of the shard)
+         */
+        int tryRemoveElement(int elm);
+
+        /**
+         * @brief Removes a batch of elements, one occurrence for every value in the batch
+         * @return int - the number of elements removed
+         */
+        int removeElements(std::span<const int> elms);
+    };
+}
+
+#endif //MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_H
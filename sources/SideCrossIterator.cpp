@@ -6,87 +6,155 @@
 using namespace ariel;
 
 typedef std::vector<int>::size_type size_type;
-typedef MagicalContainer::SideCrossIterator SideCrossIterator;
 
-SideCrossIterator::SideCrossIterator(MagicalContainer& container)
-: _container(container), start_or_end(false), index_from_end(container.size()), index_from_start(0), current_index(0) {}
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::BasicSideCrossIterator(): _container(nullptr), current_index(0) {}
 
-SideCrossIterator::SideCrossIterator(MagicalContainer& container, int index)
-: _container(container), index_from_end(container.size()), index_from_start(0){
-    if(index < 0 || index > container.size()){
-        throw std::out_of_range("SideCrossIterator: iterator out of range");
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::BasicSideCrossIterator(MagicalContainer& container)
+: _container(&container), current_index(0) {}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::BasicSideCrossIterator(const MagicalContainer& container, int index)
+: _container(&container) {
+    if constexpr (Checks::checks) {
+        if(index < 0 || index > container.size()){
+            throw std::out_of_range("SideCrossIterator: iterator out of range");
+        }
     }
     current_index = index;
 }
 
-SideCrossIterator::SideCrossIterator(const SideCrossIterator& other)
-: _container(other._container), current_index(other.current_index), index_from_end(other.index_from_end),
-index_from_start(other.index_from_start) {}
-
-SideCrossIterator SideCrossIterator::begin() {
-    return SideCrossIterator(_container, 0);
-}
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::BasicSideCrossIterator(const BasicSideCrossIterator& other)
+: _container(other._container), current_index(other.current_index) {}
 
-SideCrossIterator SideCrossIterator::end() {
-    return SideCrossIterator(_container, _container.size());
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks> MagicalContainer::BasicSideCrossIterator<Checks>::begin() {
+    return BasicSideCrossIterator(*_container, 0);
 }
 
-int SideCrossIterator::operator*() const {
-    return _container.at((size_type)current_index);
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks> MagicalContainer::BasicSideCrossIterator<Checks>::end() {
+    return BasicSideCrossIterator(*_container, _container->size());
 }
 
-bool SideCrossIterator::operator==(const SideCrossIterator &other) const {
-    return current_index == other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicSideCrossIterator<Checks>::operator<(const BasicSideCrossIterator& other) const {
+    return current_index < other.current_index;
 }
 
-bool SideCrossIterator::operator!=(const SideCrossIterator &other) const {
-    return !(*this == other);
+template<typename Checks>
+bool MagicalContainer::BasicSideCrossIterator<Checks>::operator>(const BasicSideCrossIterator& other) const {
+    return current_index > other.current_index;
 }
 
-bool SideCrossIterator::operator<(const SideCrossIterator &other) const {
-    return current_index < other.current_index;
+template<typename Checks>
+bool MagicalContainer::BasicSideCrossIterator<Checks>::operator<=(const BasicSideCrossIterator& other) const {
+    return current_index <= other.current_index;
 }
 
-bool SideCrossIterator::operator>(const SideCrossIterator &other) const {
-    return (current_index > other.current_index) && (*this != other);
+template<typename Checks>
+bool MagicalContainer::BasicSideCrossIterator<Checks>::operator>=(const BasicSideCrossIterator& other) const {
+    return current_index >= other.current_index;
 }
 
-const SideCrossIterator SideCrossIterator::operator++(int) {
-    const SideCrossIterator sci = SideCrossIterator(*this);
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks> MagicalContainer::BasicSideCrossIterator<Checks>::operator++(int){
+    BasicSideCrossIterator temp = BasicSideCrossIterator(*this);
     ++(*this);
-    return sci;
+    return temp;
 }
 
-SideCrossIterator& SideCrossIterator::operator++() {
-    if(current_index >= _container.size()){
-        throw std::runtime_error("SideCrossIterator: iterator out of range");
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>& MagicalContainer::BasicSideCrossIterator<Checks>::operator--(){
+    if constexpr (Checks::checks) {
+        if(current_index <= 0){
+            throw std::runtime_error("SideCrossIterator: iterator out of range");
+        }
     }
-    if(index_from_end != index_from_start + 1){
-        if(start_or_end){ //in right side
-            index_from_start++;
-            current_index = index_from_start;
-            start_or_end = false;
+    current_index--;
+    return *this;
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks> MagicalContainer::BasicSideCrossIterator<Checks>::operator--(int){
+    BasicSideCrossIterator temp = BasicSideCrossIterator(*this);
+    --(*this);
+    return temp;
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>&
+MagicalContainer::BasicSideCrossIterator<Checks>::operator+=(difference_type steps) {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target > _container->size()){
+            throw std::out_of_range("SideCrossIterator: iterator out of range");
         }
-        else{
-            index_from_end--;
-            current_index = index_from_end;
-            start_or_end = true;
+    }
+    current_index = (int)target;
+    return *this;
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>&
+MagicalContainer::BasicSideCrossIterator<Checks>::operator-=(difference_type steps) {
+    return *this += -steps;
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::operator+(difference_type steps) const {
+    BasicSideCrossIterator moved(*this);
+    moved += steps;
+    return moved;
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>::operator-(difference_type steps) const {
+    BasicSideCrossIterator moved(*this);
+    moved -= steps;
+    return moved;
+}
+
+template<typename Checks>
+std::ptrdiff_t MagicalContainer::BasicSideCrossIterator<Checks>::operator-(const BasicSideCrossIterator& other) const {
+    return current_index - other.current_index;
+}
+
+template<typename Checks>
+const int& MagicalContainer::BasicSideCrossIterator<Checks>::operator[](difference_type steps) const {
+    difference_type target = current_index + steps;
+    if constexpr (Checks::checks) {
+        if(target < 0 || target >= _container->size()){
+            throw std::out_of_range("SideCrossIterator: iterator out of range");
         }
-        return *this;
+        return _container->at(indexAt((int)target));
     }
-    else{
-        current_index = _container.size();
-        return *this;
+    else {
+        return _container->atUnchecked(indexAt((int)target));
     }
 }
 
-SideCrossIterator& SideCrossIterator::operator=(const SideCrossIterator &other) {
-    if(this->_container != other._container)
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>&
+MagicalContainer::BasicSideCrossIterator<Checks>::operator=(const BasicSideCrossIterator& other) {
+    if(_container != nullptr && _container != other._container)
         throw std::runtime_error("SideCrossIterator: iterators are not from the same container");
-    _container = other._container;
-    start_or_end = other.start_or_end;
-    index_from_start = other.index_from_start;
-    index_from_end = other.index_from_end;
-    current_index = other.current_index;
+    if (this != &other) {
+        _container = other._container;
+        current_index = other.current_index;
+    }
     return *this;
-}
\ No newline at end of file
+}
+
+template<typename Checks>
+MagicalContainer::BasicSideCrossIterator<Checks>&
+MagicalContainer::BasicSideCrossIterator<Checks>::operator=(BasicSideCrossIterator&& other) {
+    return *this = other;
+}
+
+template class MagicalContainer::BasicSideCrossIterator<Checked>;
+template class MagicalContainer::BasicSideCrossIterator<Unchecked>;
@@ -0,0 +1,134 @@
+//
+// Created by super on 6/27/23.
+//
+
+#include "SnapshotMagicalContainer.hpp"
+#include <algorithm>
+#include <functional>
+#include <thread>
+using namespace ariel;
+
+typedef std::vector<int>::size_type size_type;
+typedef SnapshotMagicalContainer::Snapshot Snapshot;
+
+Snapshot::Snapshot(const SnapshotMagicalContainer* owner, ReaderSlot* slot, MagicalContainer* container)
+: owner(owner), slot(slot), _container(container) {}
+
+Snapshot::Snapshot(Snapshot&& other) noexcept: owner(other.owner), slot(other.slot), _container(other._container) {
+    other.slot = nullptr;
+    other._container = nullptr;
+}
+
+Snapshot::~Snapshot() {
+    if(slot != nullptr){
+        // The release is ordered before the load of waiting (both seq_cst), so either a reader that starts waiting
+        // after it finds the slot IDLE, or this sees the reader and wakes it
+        slot->epoch.store(IDLE);
+        if(owner->waiting.load() != 0){
+            owner->releases.fetch_add(1);
+            owner->releases.notify_one();
+        }
+    }
+}
+
+SnapshotMagicalContainer::SnapshotMagicalContainer(StorageLayout layout, PrimeTest prime_test)
+: current(nullptr), global_epoch(1), slots(new ReaderSlot[MAX_READERS]), waiting(0), releases(0) {
+    for (size_type i = 0; i < MAX_READERS; i++) {
+        slots[i].epoch.store(IDLE, std::memory_order_relaxed);
+    }
+    current.store(new MagicalContainer(layout, prime_test));
+}
+
+SnapshotMagicalContainer::~SnapshotMagicalContainer() {
+    delete current.load();
+}
+
+SnapshotMagicalContainer::ReaderSlot* SnapshotMagicalContainer::claimSlot(size_type first) const {
+    for (size_type k = 0; k < MAX_READERS; k++) {
+        ReaderSlot& slot = slots[(first + k) % MAX_READERS];
+        uint64_t idle = IDLE;
+        if(slot.epoch.compare_exchange_strong(idle, global_epoch.load())){
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+Snapshot SnapshotMagicalContainer::snapshot() const {
+    // Threads start looking at different slots, so they rarely contend for one
+    size_type first = std::hash<std::thread::id>()(std::this_thread::get_id()) % MAX_READERS;
+    ReaderSlot* slot = claimSlot(first);
+    if(slot == nullptr){
+        waiting.fetch_add(1);
+        while(true){
+            // Read before the scan, so a slot released after the scan changes it and the wait returns at once
+            uint32_t seen = releases.load();
+            slot = claimSlot(first);
+            if(slot != nullptr){
+                break;
+            }
+            releases.wait(seen);
+        }
+        waiting.fetch_sub(1);
+    }
+    // The announcement is ordered before the load of current (both seq_cst), so either a writer that replaces
+    // current after it sees the announcement, or this load sees the replacement
+    return Snapshot(this, slot, current.load());
+}
+
+void SnapshotMagicalContainer::publish(std::unique_ptr<MagicalContainer> next) {
+    next->prepareReads();
+    MagicalContainer* old = current.exchange(next.release());
+    // A Snapshot that can see old announced its epoch before the exchange, so at most this one
+    retired.emplace_back(global_epoch.fetch_add(1), old);
+    reclaim();
+}
+
+void SnapshotMagicalContainer::reclaim() {
+    uint64_t oldest = UINT64_MAX;
+    for (size_type i = 0; i < MAX_READERS; i++) {
+        uint64_t epoch = slots[i].epoch.load();
+        if(epoch != IDLE){
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    std::erase_if(retired, [oldest](const auto& version) { return version.first < oldest; });
+}
+
+size_type SnapshotMagicalContainer::pendingVersions() {
+    std::lock_guard<std::mutex> lock(writer);
+    reclaim();
+    return retired.size();
+}
+
+int SnapshotMagicalContainer::size() const {
+    return snapshot().container().size();
+}
+
+int SnapshotMagicalContainer::p_size() const {
+    return snapshot().container().p_size();
+}
+
+void SnapshotMagicalContainer::setMaterializedPrimes(bool materialize) {
+    update([materialize](MagicalContainer& container) { container.setMaterializedPrimes(materialize); });
+}
+
+void SnapshotMagicalContainer::addElement(int elm) {
+    update([elm](MagicalContainer& container) { container.addElement(elm); });
+}
+
+void SnapshotMagicalContainer::addElements(std::span<const int> elms) {
+    update([elms](MagicalContainer& container) { container.addElements(elms); });
+}
+
+int SnapshotMagicalContainer::removeElement(int elm) {
+    return update([elm](MagicalContainer& container) { return container.removeElement(elm); });
+}
+
+int SnapshotMagicalContainer::tryRemoveElement(int elm) {
+    return update([elm](MagicalContainer& container) { return container.tryRemoveElement(elm); });
+}
+
+int SnapshotMagicalContainer::removeElements(std::span<const int> elms) {
+    return update([elms](MagicalContainer& container) { return container.removeElements(elms); });
+}
@@ -0,0 +1,227 @@
+//
+// Created by super on 6/27/23.
+//
+
+#ifndef MAGICAL_ITERATORS_SNAPSHOTMAGICALCONTAINER_H
+#define MAGICAL_ITERATORS_SNAPSHOTMAGICALCONTAINER_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "MagicalContainer.hpp"
+
+namespace ariel{
+    /**
+     * @brief SnapshotMagicalContainer class - a MagicalContainer with read-copy-update writes, for read-mostly use
+     * The container is a pointer to an immutable version. A write copies the current version, changes the copy and
+     * publishes it with one pointer store, so readers never wait for a writer and a write burst doesn't show in
+     * their latency. A reader pins the version it starts on with a Snapshot, and walks it with plain loads: no lock,
+     * and no atomic read-modify-write per element.
+     * Old versions are freed by epochs: a Snapshot announces the global epoch in a reader slot, a replaced version is
+     * retired with the global epoch at the time, and it is freed once every announced epoch is newer than that.
+     * Writes are serialized by a mutex and cost a copy of the container, O(n), so bursts should go through the batch
+     * operations or update(). The lazy prime index doesn't help here: every published version is prepared for
+     * shared reads (see MagicalContainer::prepareReads).
+     */
+    class SnapshotMagicalContainer {
+        /**
+         * A reader slot: the epoch a live Snapshot announced, or IDLE. One cache line each, so the readers of
+         * different slots don't share a line
+         */
+        struct alignas(64) ReaderSlot {
+            std::atomic<uint64_t> epoch;
+        };
+
+        static const uint64_t IDLE = 0;
+
+        std::atomic<MagicalContainer*> current;
+        std::atomic<uint64_t> global_epoch;
+        std::unique_ptr<ReaderSlot[]> slots;
+
+        /**
+         * The readers waiting for a slot, and the number of slots released while any were. A Snapshot that frees
+         * its slot bumps releases and wakes a waiter only when waiting is not 0, so the common release stays a store
+         */
+        mutable std::atomic<uint32_t> waiting;
+        mutable std::atomic<uint32_t> releases;
+        std::mutex writer;
+        std::vector<std::pair<uint64_t, std::unique_ptr<MagicalContainer>>> retired; // guarded by writer
+
+        /**
+         * @brief Publishes a new version and retires the one it replaces. The caller holds writer
+         */
+        void publish(std::unique_ptr<MagicalContainer> next);
+
+        /**
+         * @brief Frees the retired versions that no announced epoch can still see. The caller holds writer
+         */
+        void reclaim();
+
+        /**
+         * @brief Claims an IDLE slot for a reader, looking at every slot once from first on
+         * @return ReaderSlot* - the claimed slot, announcing the global epoch, or nullptr if all of them are busy
+         */
+        ReaderSlot* claimSlot(size_type first) const;
+
+    public:
+        /**
+         * The number of Snapshots that can be alive at once. A Snapshot taken while all the slots are busy sleeps
+         * until one of them is released
+         */
+        static const std::size_t MAX_READERS = 128;
+
+        /**
+         * @brief Snapshot class - a pinned version of the container
+         * Everything it hands out reads the version that was current when snapshot() was called, however many
+         * writes come after it, and is valid as long as the Snapshot is. Keeping one for long holds back the freeing
+         * of every version retired after it
+         */
+        class Snapshot {
+            const SnapshotMagicalContainer* owner;
+            ReaderSlot* slot;
+            MagicalContainer* _container;
+
+            Snapshot(const SnapshotMagicalContainer* owner, ReaderSlot* slot, MagicalContainer* container);
+            friend class SnapshotMagicalContainer;
+
+        public:
+            ~Snapshot();
+            Snapshot(const Snapshot& other) = delete;
+            Snapshot& operator=(const Snapshot& other) = delete;
+            Snapshot(Snapshot&& other) noexcept;
+            Snapshot& operator=(Snapshot&& other) = delete;
+
+            /**
+             * @return const MagicalContainer& - the version, for its const methods, for_each and chunks
+             */
+            const MagicalContainer& container() const {
+                return *_container;
+            }
+
+            /**
+             * @return MagicalContainer::AscendingView - the elements of the version in ascending order
+             */
+            MagicalContainer::AscendingView ascending() const {
+                return _container->ascending();
+            }
+
+            /**
+             * @return MagicalContainer::PrimeView - the prime numbers of the version in ascending order
+             */
+            MagicalContainer::PrimeView primes() const {
+                return _container->primes();
+            }
+
+            /**
+             * @return MagicalContainer::SideCrossView - the elements of the version in cross order
+             */
+            MagicalContainer::SideCrossView side_cross() const {
+                return _container->side_cross();
+            }
+        };
+
+        /**
+         * @brief A constructor that picks the storage layout of the container
+         * @param layout The layout to keep the elements in
+         * @param prime_test The test used to decide which elements the PrimeIterator visits
+         * @throws invalid_argument if prime_test is null
+         */
+        explicit SnapshotMagicalContainer(StorageLayout layout = StorageLayout::Vector,
+                                          PrimeTest prime_test = isPrime);
+
+        /**
+         * @brief Frees every version. No Snapshot may outlive the container
+         */
+        ~SnapshotMagicalContainer();
+        SnapshotMagicalContainer(const SnapshotMagicalContainer& other) = delete;
+        SnapshotMagicalContainer& operator=(const SnapshotMagicalContainer& other) = delete;
+        SnapshotMagicalContainer(SnapshotMagicalContainer&& other) = delete;
+        SnapshotMagicalContainer& operator=(SnapshotMagicalContainer&& other) = delete;
+
+        /**
+         * @brief Pins the current version
+         * @return Snapshot - the pinned version
+         * @complexity O(1): a slot claim, a store and a load, unless all MAX_READERS slots are busy: then it sleeps
+         * until a Snapshot is destroyed
+         */
+        Snapshot snapshot() const;
+
+        /**
+         * @brief Applies f to a copy of the current version and publishes the copy, so a batch of writes costs one
+         * copy. If f throws, nothing is published
+         * @param f Called as f(MagicalContainer&)
+         * @return what f returns
+         * @complexity O(n) for the copy, plus f
+         */
+        template<typename F>
+        auto update(F&& f) {
+            std::lock_guard<std::mutex> lock(writer);
+            auto next = std::make_unique<MagicalContainer>(*current.load(std::memory_order_relaxed));
+            if constexpr (std::is_void_v<decltype(f(*next))>) {
+                f(*next);
+                publish(std::move(next));
+            }
+            else {
+                auto result = f(*next);
+                publish(std::move(next));
+                return result;
+            }
+        }
+
+        /**
+         * @return int - the number of elements in the current version
+         */
+        int size() const;
+
+        /**
+         * @return int - the number of prime elements in the current version
+         */
+        int p_size() const;
+
+        /**
+         * @return size_type - the number of replaced versions that are not freed yet, because a Snapshot may still
+         * read them
+         */
+        size_type pendingVersions();
+
+        /**
+         * @see MagicalContainer::setMaterializedPrimes
+         */
+        void setMaterializedPrimes(bool materialize);
+
+        /**
+         * @see MagicalContainer::addElement
+         * @complexity O(n)
+         */
+        void addElement(int elm);
+
+        /**
+         * @see MagicalContainer::addElements
+         */
+        void addElements(std::span<const int> elms);
+
+        /**
+         * @see MagicalContainer::removeElement
+         * @throws runtime_error if the element is not in the container, and then nothing is published
+         * @complexity O(n)
+         */
+        int removeElement(int elm);
+
+        /**
+         * @see MagicalContainer::tryRemoveElement
+         * @complexity O(n)
+         */
+        int tryRemoveElement(int elm);
+
+        /**
+         * @see MagicalContainer::removeElements
+         */
+        int removeElements(std::span<const int> elms);
+    };
+}
+
+#endif //MAGICAL_ITERATORS_SNAPSHOTMAGICALCONTAINER_H
@@ -0,0 +1,226 @@
+//
+// Created by super on 6/18/23.
+//
+
+#include "TieredStorage.hpp"
+#include <algorithm>
+#include <stdexcept>
+using namespace ariel;
+
+TieredStorage::TieredStorage(): element_count(0), prime_count(0), last_block(0) {}
+
+std::size_t TieredStorage::size() const {
+    return element_count;
+}
+
+std::size_t TieredStorage::primeCount() const {
+    return prime_count;
+}
+
+std::size_t TieredStorage::blockFor(int value) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), value, [](int val, const Block& block) {
+        return val < block.keys.front();
+    });
+    return it == blocks.begin() ? blocks.size() : (std::size_t)(it - blocks.begin()) - 1;
+}
+
+void TieredStorage::refreshDirectory(std::size_t first) {
+    starts.resize(blocks.size());
+    prime_starts.resize(blocks.size());
+    for (std::size_t i = first; i < blocks.size(); i++) {
+        starts[i] = i == 0 ? 0 : starts[i - 1] + blocks[i - 1].keys.size();
+        prime_starts[i] = i == 0 ? 0 : prime_starts[i - 1] + blocks[i - 1].prime_positions.size();
+    }
+    if (last_block.load(std::memory_order_relaxed) >= blocks.size()) {
+        last_block.store(0, std::memory_order_relaxed);
+    }
+}
+
+void TieredStorage::split(std::size_t block) {
+    Block right;
+    Block& left = blocks[block];
+    std::size_t half = left.keys.size() / 2;
+    right.keys.assign(left.keys.begin() + (long)half, left.keys.end());
+    left.keys.resize(half);
+    auto first_right = std::lower_bound(left.prime_positions.begin(), left.prime_positions.end(), half);
+    for (auto it = first_right; it != left.prime_positions.end(); ++it) {
+        right.prime_positions.push_back((uint16_t)(*it - half));
+    }
+    left.prime_positions.erase(first_right, left.prime_positions.end());
+    blocks.insert(blocks.begin() + (long)block + 1, std::move(right));
+}
+
+void TieredStorage::mergeSmall(std::size_t block) {
+    if (blocks[block].keys.size() >= BLOCK_CAPACITY / 4) {
+        return;
+    }
+    std::size_t left = 0;
+    if (block + 1 < blocks.size() && blocks[block].keys.size() + blocks[block + 1].keys.size() <= BLOCK_CAPACITY) {
+        left = block;
+    }
+    else if (block > 0 && blocks[block - 1].keys.size() + blocks[block].keys.size() <= BLOCK_CAPACITY) {
+        left = block - 1;
+    }
+    else {
+        return;
+    }
+    Block& into = blocks[left];
+    Block& from = blocks[left + 1];
+    auto offset = (uint16_t)into.keys.size();
+    into.keys.insert(into.keys.end(), from.keys.begin(), from.keys.end());
+    for (uint16_t pos : from.prime_positions) {
+        into.prime_positions.push_back((uint16_t)(pos + offset));
+    }
+    blocks.erase(blocks.begin() + (long)left + 1);
+}
+
+const int& TieredStorage::at(std::size_t rank) const {
+    if (rank >= element_count) {
+        throw std::out_of_range("TieredStorage: rank out of range");
+    }
+    std::size_t block = blockOfRank(rank);
+    return blocks[block].keys[rank - starts[block]];
+}
+
+std::size_t TieredStorage::blockOfRank(std::size_t rank) const {
+    std::size_t block = last_block.load(std::memory_order_relaxed);
+    if (rank < starts[block] || rank - starts[block] >= blocks[block].keys.size()) {
+        block = (std::size_t)(std::upper_bound(starts.begin(), starts.end(), rank) - starts.begin()) - 1;
+        last_block.store(block, std::memory_order_relaxed);
+    }
+    return block;
+}
+
+std::span<const int> TieredStorage::runAt(std::size_t rank) const {
+    if (rank >= element_count) {
+        throw std::out_of_range("TieredStorage: rank out of range");
+    }
+    std::size_t block = blockOfRank(rank);
+    const std::vector<int>& keys = blocks[block].keys;
+    return std::span<const int>(keys).subspan(rank - starts[block]);
+}
+
+std::size_t TieredStorage::primeRank(std::size_t k) const {
+    if (k >= prime_count) {
+        throw std::out_of_range("TieredStorage: prime index out of range");
+    }
+    // The last block that starts with at most k primes before it and has primes in it
+    std::size_t block = (std::size_t)(std::upper_bound(prime_starts.begin(), prime_starts.end(), k) -
+                                      prime_starts.begin()) - 1;
+    return starts[block] + blocks[block].prime_positions[k - prime_starts[block]];
+}
+
+const int& TieredStorage::primeValue(std::size_t k) const {
+    if (k >= prime_count) {
+        throw std::out_of_range("TieredStorage: prime index out of range");
+    }
+    std::size_t block = (std::size_t)(std::upper_bound(prime_starts.begin(), prime_starts.end(), k) -
+                                      prime_starts.begin()) - 1;
+    return blocks[block].keys[blocks[block].prime_positions[k - prime_starts[block]]];
+}
+
+void TieredStorage::insert(int value, bool prime) {
+    std::size_t block = 0;
+    if (blocks.empty()) {
+        blocks.emplace_back();
+    }
+    else {
+        block = blockFor(value);
+        block = block == blocks.size() ? 0 : block;
+    }
+    Block& target = blocks[block];
+    auto pos = (uint16_t)(std::lower_bound(target.keys.begin(), target.keys.end(), value) - target.keys.begin());
+    target.keys.insert(target.keys.begin() + pos, value);
+    auto it_prime = std::lower_bound(target.prime_positions.begin(), target.prime_positions.end(), pos);
+    for (auto shift = it_prime; shift != target.prime_positions.end(); ++shift) {
+        (*shift)++;
+    }
+    if (prime) {
+        target.prime_positions.insert(it_prime, pos);
+    }
+    if (target.keys.size() >= BLOCK_CAPACITY) {
+        split(block);
+    }
+    element_count++;
+    prime_count += prime ? 1 : 0;
+    refreshDirectory(block);
+}
+
+bool TieredStorage::erase(int value) {
+    std::size_t block = blockFor(value);
+    if (block == blocks.size()) {
+        return false;
+    }
+    Block& target = blocks[block];
+    auto it = std::lower_bound(target.keys.begin(), target.keys.end(), value);
+    if (it == target.keys.end() || *it != value) {
+        return false;
+    }
+    auto pos = (uint16_t)(it - target.keys.begin());
+    target.keys.erase(it);
+    auto it_prime = std::lower_bound(target.prime_positions.begin(), target.prime_positions.end(), pos);
+    if (it_prime != target.prime_positions.end() && *it_prime == pos) {
+        it_prime = target.prime_positions.erase(it_prime);
+        prime_count--;
+    }
+    for (auto shift = it_prime; shift != target.prime_positions.end(); ++shift) {
+        (*shift)--;
+    }
+    element_count--;
+    if (target.keys.empty()) {
+        blocks.erase(blocks.begin() + (long)block);
+    }
+    else {
+        mergeSmall(block);
+    }
+    refreshDirectory(block == 0 ? 0 : block - 1);
+    return true;
+}
+
+void TieredStorage::exportTo(std::vector<int>& values, PrimeBitmap& primes) const {
+    values.clear();
+    primes.clear();
+    values.reserve(element_count);
+    primes.reserve(element_count);
+    for (const Block& block : blocks) {
+        auto next_prime = block.prime_positions.begin();
+        for (std::size_t i = 0; i < block.keys.size(); i++) {
+            bool prime = next_prime != block.prime_positions.end() && *next_prime == i;
+            if (prime) {
+                ++next_prime;
+            }
+            primes.push_back(prime);
+        }
+        values.insert(values.end(), block.keys.begin(), block.keys.end());
+    }
+}
+
+void TieredStorage::assign(const std::vector<int>& values, const PrimeBitmap& primes) {
+    const std::size_t fill = BLOCK_CAPACITY * 3 / 4;
+    blocks.clear();
+    element_count = values.size();
+    prime_count = primes.count();
+    for (std::size_t begin = 0; begin < values.size(); begin += fill) {
+        std::size_t end = std::min(values.size(), begin + fill);
+        Block block;
+        block.keys.assign(values.begin() + (long)begin, values.begin() + (long)end);
+        for (std::size_t i = begin; i < end; i++) {
+            if (primes.test(i)) {
+                block.prime_positions.push_back((uint16_t)(i - begin));
+            }
+        }
+        blocks.push_back(std::move(block));
+    }
+    last_block.store(0, std::memory_order_relaxed);
+    refreshDirectory(0);
+}
+
+std::unique_ptr<OrderedStorage> TieredStorage::clone() const {
+    auto other = std::make_unique<TieredStorage>();
+    other->blocks = blocks;
+    other->starts = starts;
+    other->prime_starts = prime_starts;
+    other->element_count = element_count;
+    other->prime_count = prime_count;
+    return other;
+}
@@ -0,0 +1,121 @@
+//
+// Created by super on 6/18/23.
+//
+
+#ifndef MAGICAL_ITERATORS_TIEREDSTORAGE_H
+#define MAGICAL_ITERATORS_TIEREDSTORAGE_H
+#include <atomic>
+#include <cstdint>
+#include "OrderedStorage.hpp"
+
+namespace ariel{
+    /**
+     * @brief TieredStorage class - a tiered vector: the elements are kept in sorted blocks of up to BLOCK_CAPACITY
+     * elements, plus a small directory of the rank of the first element and of the first prime of every block.
+     * An insert or a remove moves at most one block and patches the directory, O(sqrt(n)) for containers of up to a
+     * few million elements. Every block keeps the positions of its primes in a small sorted array, and at() remembers
+     * the last block it read so a traversal touches the directory once per block.
+     */
+    class TieredStorage : public OrderedStorage {
+        struct Block {
+            std::vector<int> keys;
+            std::vector<uint16_t> prime_positions; // the positions of the primes in keys, ascending
+        };
+
+        std::vector<Block> blocks;
+        std::vector<std::size_t> starts;       // the rank of the first element of every block
+        std::vector<std::size_t> prime_starts; // the number of primes before every block
+        std::size_t element_count;
+        std::size_t prime_count;
+        mutable std::atomic<std::size_t> last_block; // the block the last at() call read. A relaxed atomic, so
+                                                     // threads can read the storage at the same time
+
+        /**
+         * @return std::size_t - the last block whose first element is <= value, or blocks.size() if there is none
+         */
+        std::size_t blockFor(int value) const;
+
+        /**
+         * @brief Recomputes starts and prime_starts from block first onwards
+         */
+        void refreshDirectory(std::size_t first);
+
+        /**
+         * @return std::size_t - the block that holds the element of the given rank, starting from last_block
+         */
+        std::size_t blockOfRank(std::size_t rank) const;
+
+        /**
+         * @brief Splits a full block into two halves
+         */
+        void split(std::size_t block);
+
+        /**
+         * @brief Merges a small block with one of its neighbours if they fit in one block
+         */
+        void mergeSmall(std::size_t block);
+
+    public:
+        static const std::size_t BLOCK_CAPACITY = 1024;
+
+        TieredStorage();
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t size() const override;
+
+        /**
+         * @complexity O(1)
+         */
+        std::size_t primeCount() const override;
+
+        /**
+         * @complexity O(1) when rank is in the block of the previous call, O(log(n / BLOCK_CAPACITY)) otherwise
+         */
+        const int& at(std::size_t rank) const override;
+
+        /**
+         * @complexity O(1) when rank is in the block of the previous call, O(log(n / BLOCK_CAPACITY)) otherwise
+         */
+        std::span<const int> runAt(std::size_t rank) const override;
+
+        /**
+         * @complexity O(log(n / BLOCK_CAPACITY))
+         */
+        std::size_t primeRank(std::size_t k) const override;
+
+        /**
+         * @complexity O(log(n / BLOCK_CAPACITY)), one walk instead of primeRank() and at()
+         */
+        const int& primeValue(std::size_t k) const override;
+
+        /**
+         * @complexity O(BLOCK_CAPACITY + n / BLOCK_CAPACITY)
+         */
+        void insert(int value, bool prime) override;
+
+        /**
+         * @complexity O(BLOCK_CAPACITY + n / BLOCK_CAPACITY)
+         */
+        bool erase(int value) override;
+
+        /**
+         * @complexity O(n)
+         */
+        void exportTo(std::vector<int>& values, PrimeBitmap& primes) const override;
+
+        /**
+         * @brief Splits the elements into blocks filled to 3/4, leaving room for later inserts
+         * @complexity O(n)
+         */
+        void assign(const std::vector<int>& values, const PrimeBitmap& primes) override;
+
+        /**
+         * @complexity O(n)
+         */
+        std::unique_ptr<OrderedStorage> clone() const override;
+    };
+}
+
+#endif //MAGICAL_ITERATORS_TIEREDSTORAGE_H